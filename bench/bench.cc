@@ -0,0 +1,297 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+
+#include "perf_counters.h"
+#include "stats.h"
+#include "zlib.h"
+
+namespace filterx {
+namespace bench {
+
+BenchOptions options;
+
+static double tick_seconds = 0;
+static volatile uint64_t sink_value = 0;
+
+double
+ticks_to_seconds(uint64_t ticks) {
+  return ticks * tick_seconds;
+}
+
+void
+sink(uint64_t value) {
+  sink_value = sink_value + value;
+}
+
+static void
+calibrate_ticks() {
+  auto start_time = std::chrono::steady_clock::now();
+  auto start = stats_ticks();
+  while (std::chrono::steady_clock::now() - start_time
+         < std::chrono::milliseconds(50)) {
+  }
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start_time)
+                     .count();
+  tick_seconds = elapsed / (stats_ticks() - start);
+}
+
+// removes the scratch directory at exit
+struct ScratchDir {
+  std::string path;
+
+  ~ScratchDir() {
+    if (!this->path.empty()) {
+      std::error_code error;
+      std::filesystem::remove_all(this->path, error);
+    }
+  }
+};
+
+static ScratchDir scratch;
+
+const std::string&
+scratch_dir() {
+  if (scratch.path.empty()) {
+    std::random_device random;
+    char name[64];
+    snprintf(name, sizeof(name), "filterx-bench-%08x", random());
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::error_code error;
+    if (!std::filesystem::create_directories(path, error)) {
+      fprintf(stderr, "Failed to create directory: %s\n",
+              path.string().c_str());
+      exit(EXIT_FAILURE);
+    }
+    scratch.path = path.string();
+  }
+  return scratch.path;
+}
+
+std::vector<std::string>
+make_lines(uint64_t nrows, int ncolumns, int group_size, uint64_t first_key,
+           uint64_t key_step) {
+  std::vector<std::string> lines;
+  lines.reserve(nrows);
+  std::mt19937_64 random(nrows * 31 + ncolumns);
+  char field[32];
+  for (uint64_t i = 0; i < nrows; i++) {
+    std::string line;
+    // zero padded, so string and int keys sort the same way
+    snprintf(field, sizeof(field), "%012llu",
+             (unsigned long long)(first_key + i / group_size * key_step));
+    line.append(field);
+    for (int j = 1; j < ncolumns; j++) {
+      line.push_back('\t');
+      snprintf(field, sizeof(field), "%llu",
+               (unsigned long long)(random() % 1000000));
+      line.append(field);
+    }
+    lines.push_back(std::move(line));
+  }
+  return lines;
+}
+
+void
+write_lines(const std::string& path, std::vector<std::string>& lines) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    fprintf(stderr, "Failed to open file: %s\n", path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  for (auto& line : lines) {
+    fwrite(line.data(), 1, line.size(), file);
+    fputc('\n', file);
+  }
+  fclose(file);
+}
+
+void
+write_lines_gzip(const std::string& path, std::vector<std::string>& lines) {
+  gzFile file = gzopen(path.c_str(), "wb6");
+  if (file == nullptr) {
+    fprintf(stderr, "Failed to open file: %s\n", path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  for (auto& line : lines) {
+    gzwrite(file, line.data(), line.size());
+    gzputc(file, '\n');
+  }
+  gzclose(file);
+}
+
+static void
+run(Benchmark& benchmark, PerfCounters* counters) {
+  auto pass = benchmark.prepare();
+  // the first pass warms caches and allocators up
+  pass();
+  double total = 0;
+  double best = 0;
+  PassResult best_result;
+  int npasses = 0;
+  uint64_t rows = 0;
+  uint64_t before[CounterCount];
+  uint64_t after[CounterCount];
+  if (counters != nullptr) {
+    counters->read(before);
+  }
+  while (npasses == 0 || total < options.min_time) {
+    auto start = std::chrono::steady_clock::now();
+    auto result = pass();
+    double seconds = result.seconds;
+    if (seconds < 0) {
+      seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    }
+    if (npasses == 0 || seconds < best) {
+      best = seconds;
+      best_result = result;
+    }
+    total += seconds;
+    rows += result.rows;
+    npasses++;
+  }
+  printf("%-36s %10.2f", benchmark.name.c_str(),
+         best_result.rows > 0 ? best * 1e9 / best_result.rows : 0.0);
+  if (best_result.bytes > 0 && best > 0) {
+    printf(" %8.3f", best_result.bytes / best / 1e9);
+  } else {
+    printf(" %8s", "-");
+  }
+  printf(" %7d", npasses);
+  if (counters != nullptr && rows > 0) {
+    counters->read(after);
+    // over whole passes, setup included
+    double cycles = after[CounterCycles] - before[CounterCycles];
+    double instructions
+        = after[CounterInstructions] - before[CounterInstructions];
+    printf(" %10.1f %5.2f %10.4f %10.4f", cycles / rows,
+           cycles > 0 ? instructions / cycles : 0.0,
+           1.0 * (after[CounterBranchMisses] - before[CounterBranchMisses])
+               / rows,
+           1.0 * (after[CounterLlcMisses] - before[CounterLlcMisses]) / rows);
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+static void
+usage() {
+  fprintf(stderr, "Usage: filterx-bench [options] [name ...]\n");
+  fprintf(stderr, "Runs the benchmarks whose name contains one of the names, "
+                  "all by default.\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --min-time <seconds>  Repeat every benchmark for at "
+                  "least <seconds>, default\n"
+                  "                        is 0.5\n");
+  fprintf(stderr, "  --rows <n>            Rows of the generated data, "
+                  "default is 1048576\n");
+  fprintf(stderr, "  --counters            Add cycles, ipc, branch and cache "
+                  "misses per row\n");
+  fprintf(stderr, "  --list                List the benchmarks\n");
+  fprintf(stderr, "  --check-allocs        Fail if the merge allocates per "
+                  "row, needs a build\n"
+                  "                        with FILTERX_ALLOC_STATS\n");
+  fprintf(stderr, "  -h, --help            Show this help message\n");
+  fprintf(stderr, "ns/row and GB/s are of the fastest pass.\n");
+}
+
+} // namespace bench
+} // namespace filterx
+
+int
+main(int argc, char** argv) {
+  using namespace filterx::bench;
+  std::vector<std::string> names;
+  bool list_only = false;
+  bool check_allocs_only = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+      usage();
+      return 0;
+    }
+    if (strcmp(argv[i], "--list") == 0) {
+      list_only = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--check-allocs") == 0) {
+      check_allocs_only = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--counters") == 0) {
+      options.counters = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+      options.min_time = atof(argv[++i]);
+      continue;
+    }
+    if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+      options.rows = strtoull(argv[++i], nullptr, 10);
+      if (options.rows < 1024) {
+        fprintf(stderr, "rows should be at least 1024\n");
+        return EXIT_FAILURE;
+      }
+      continue;
+    }
+    if (argv[i][0] == '-') {
+      fprintf(stderr, "unknown option: %s\n", argv[i]);
+      usage();
+      return EXIT_FAILURE;
+    }
+    names.push_back(argv[i]);
+  }
+
+  if (check_allocs_only) {
+    return check_allocs();
+  }
+
+  std::vector<Benchmark> benchmarks;
+  add_row_benchmarks(&benchmarks);
+  add_key_benchmarks(&benchmarks);
+  add_row_buffer_benchmarks(&benchmarks);
+  add_merge_benchmarks(&benchmarks);
+  add_provider_benchmarks(&benchmarks);
+  if (list_only) {
+    for (auto& benchmark : benchmarks) {
+      printf("%s\n", benchmark.name.c_str());
+    }
+    return 0;
+  }
+
+  filterx::PerfCounters counters;
+  bool use_counters = false;
+  if (options.counters) {
+    std::string error;
+    use_counters = counters.open(&error);
+    if (!use_counters) {
+      fprintf(stderr, "warning: counters are not available, %s\n",
+              error.c_str());
+    }
+  }
+  calibrate_ticks();
+  printf("%-36s %10s %8s %7s", "benchmark", "ns/row", "GB/s", "passes");
+  if (use_counters) {
+    printf(" %10s %5s %10s %10s", "cycles/row", "ipc", "br_miss", "llc_miss");
+  }
+  printf("\n");
+  for (auto& benchmark : benchmarks) {
+    bool selected = names.empty();
+    for (auto& name : names) {
+      if (benchmark.name.find(name) != std::string::npos) {
+        selected = true;
+      }
+    }
+    if (selected) {
+      run(benchmark, use_counters ? &counters : nullptr);
+    }
+  }
+  return 0;
+}
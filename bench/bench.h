@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace filterx {
+namespace bench {
+
+// what one pass of a benchmark went over
+struct PassResult {
+  uint64_t rows = 0;
+  // input bytes, 0 where bytes do not mean anything
+  uint64_t bytes = 0;
+  // time of the measured part of the pass, negative to time the whole pass
+  double seconds = -1;
+};
+
+typedef std::function<PassResult()> Pass;
+
+// prepare builds the data of a benchmark and returns its pass, it is only
+// called for the benchmarks that run
+struct Benchmark {
+  std::string name;
+  std::function<Pass()> prepare;
+};
+
+struct BenchOptions {
+  // a benchmark repeats its pass for at least this long
+  double min_time = 0.5;
+  // rows of the generated data, each benchmark scales it to its cost
+  uint64_t rows = 1 << 20;
+  bool counters = false;
+};
+
+extern BenchOptions options;
+
+void add_row_benchmarks(std::vector<Benchmark>* list);
+void add_key_benchmarks(std::vector<Benchmark>* list);
+void add_row_buffer_benchmarks(std::vector<Benchmark>* list);
+void add_merge_benchmarks(std::vector<Benchmark>* list);
+void add_provider_benchmarks(std::vector<Benchmark>* list);
+
+// runs the merge over more and more rows and fails if it allocates per row,
+// for builds with FILTERX_ALLOC_STATS
+int check_allocs();
+
+// seconds of a number of stats_ticks(), calibrated at startup
+double ticks_to_seconds(uint64_t ticks);
+
+// a directory for generated input files, removed at exit
+const std::string& scratch_dir();
+
+// tab separated lines of ncolumns columns, the first column is the key.
+// every key is repeated group_size times, keys increase from first_key in
+// steps of key_step
+std::vector<std::string> make_lines(uint64_t nrows, int ncolumns,
+                                    int group_size = 1, uint64_t first_key = 0,
+                                    uint64_t key_step = 1);
+void write_lines(const std::string& path, std::vector<std::string>& lines);
+void write_lines_gzip(const std::string& path,
+                      std::vector<std::string>& lines);
+
+// keeps the compiler from dropping a result
+void sink(uint64_t value);
+
+} // namespace bench
+} // namespace filterx
@@ -0,0 +1,110 @@
+#include "alloc_stats.h"
+#include "bench.h"
+#include "process.h"
+
+namespace filterx {
+namespace bench {
+
+// extra allocations allowed per extra row, for buffers that still grow
+// now and then with longer input
+static const double STEADY_ALLOCS_PER_ROW = 0.001;
+
+struct AllocCase {
+  const char* name;
+  std::vector<std::string> args;
+  int group_size;
+  bool gzip;
+};
+
+// allocations of one merge of three files of nrows rows, setup and parsing
+// included. the second file has every second key of the first, the third
+// every third one
+static uint64_t
+count_allocs(AllocCase& c, uint64_t nrows) {
+  std::vector<std::string> args{ "filterx" };
+  args.insert(args.end(), c.args.begin(), c.args.end());
+  for (int i = 0; i < 3; i++) {
+    auto lines = make_lines(nrows, 6, c.group_size, 0, i + 1);
+    auto path = scratch_dir() + "/alloc-" + c.name + "-" + std::to_string(i)
+                + (c.gzip ? ".txt.gz" : ".txt");
+    if (c.gzip) {
+      write_lines_gzip(path, lines);
+    } else {
+      write_lines(path, lines);
+    }
+    args.push_back(path);
+  }
+  args.push_back("-o");
+  args.push_back(scratch_dir() + "/alloc-output.txt");
+  std::vector<char*> argv;
+  for (auto& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  auto before = alloc_total();
+  {
+    GroupParamsList group_params;
+    FileParamsList file_params;
+    ProcessorParams process_params = defaultProcessorParams;
+    parse(argv.size() - 1, argv.data(), &group_params, &file_params,
+          &process_params);
+    symbol_table.set_enabled(process_params.intern);
+    Processor processor(process_params);
+    processor.select_kernel(&file_params.front());
+    for (auto& file_param : file_params) {
+      processor.add_record(create_record_from_file_param(&file_param));
+    }
+    processor.prepare();
+    processor.process();
+  }
+  symbol_table.set_enabled(false);
+  return alloc_total().calls - before.calls;
+}
+
+// the merge path must not allocate per row once its buffers are warm: a run
+// over twice the rows may only allocate a little more than a run over the
+// rows
+int
+check_allocs() {
+  if (!ALLOC_STATS) {
+    fprintf(stderr, "--check-allocs needs a build with "
+                    "FILTERX_ALLOC_STATS defined\n");
+    return EXIT_FAILURE;
+  }
+  std::vector<AllocCase> cases = {
+    { "string", { "-1", "k=1s" }, 1, false },
+    { "int", { "-1", "k=1i" }, 4, false },
+    { "generic", { "-1", "k=1s", "--kernel", "generic" }, 4, false },
+    { "row", { "-1", "k=1s", "-R", "-F" }, 4, false },
+    { "top", { "-1", "k=1s:top=2:by=2I" }, 4, false },
+    { "agg", { "-1", "k=1s", "--agg", "count,sum:2" }, 4, false },
+    { "limit", { "-1", "k=1s:l=1" }, 4, false },
+    { "gzip", { "-1", "k=1s" }, 2, true },
+  };
+  uint64_t nrows = std::max<uint64_t>(options.rows / 64, 1 << 12);
+  int failed = 0;
+  printf("%-36s %12s %12s %10s\n", "case", "allocs", "allocs_2x",
+         "extra/row");
+  for (auto& c : cases) {
+    uint64_t base = count_allocs(c, nrows);
+    uint64_t twice = count_allocs(c, nrows * 2);
+    double extra
+        = twice > base ? 1.0 * (twice - base) / (nrows * 3) : 0.0;
+    bool ok = extra <= STEADY_ALLOCS_PER_ROW;
+    printf("%-36s %12llu %12llu %10.4f%s\n", c.name, (unsigned long long)base,
+           (unsigned long long)twice, extra, ok ? "" : "  FAILED");
+    if (!ok) {
+      failed++;
+    }
+  }
+  fflush(stdout);
+  if (failed > 0) {
+    fprintf(stderr, "%d cases allocate per row\n", failed);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
+
+} // namespace bench
+} // namespace filterx
@@ -0,0 +1,115 @@
+#include "bench.h"
+#include "row.h"
+
+#include <memory>
+#include <random>
+
+namespace filterx {
+namespace bench {
+
+static std::vector<std::string>
+make_keys(RowKeyType type, uint64_t nkeys) {
+  std::vector<std::string> keys;
+  keys.reserve(nkeys);
+  std::mt19937_64 random(nkeys);
+  char text[32];
+  for (uint64_t i = 0; i < nkeys; i++) {
+    if (type == RowKeyTypeFloat) {
+      snprintf(text, sizeof(text), "%.6f", (random() % 100000000) / 1000.0);
+    } else if (type == RowKeyTypeInt) {
+      snprintf(text, sizeof(text), "%llu",
+               (unsigned long long)(random() % 1000000000));
+    } else {
+      // sorted like the keys of a merge, neighbours share a prefix
+      snprintf(text, sizeof(text), "chr%02d_%012llu", (int)(i * 24 / nkeys),
+               (unsigned long long)i * 7);
+    }
+    keys.push_back(text);
+  }
+  return keys;
+}
+
+// TypedKey::to_int and to_float of keys not parsed before
+static Benchmark
+parse_benchmark(const char* name, RowKeyType type, uint64_t nkeys) {
+  return { name, [type, nkeys]() {
+            auto keys = std::make_shared<std::vector<std::string> >(
+                make_keys(type, nkeys));
+            return Pass([keys, type]() {
+              PassResult result;
+              TypedKey key(type, "", RowKeySortOrderAsc);
+              uint64_t sum = 0;
+              for (auto& text : *keys) {
+                key.update_key(text);
+                if (type == RowKeyTypeInt) {
+                  sum += key.to_int();
+                } else {
+                  sum += (uint64_t)key.to_float();
+                }
+                result.bytes += text.size();
+              }
+              sink(sum);
+              result.rows = keys->size();
+              return result;
+            });
+          } };
+}
+
+// TypedKey::small_than and equals of neighbouring keys, with their values
+// parsed or interned already as they are in rows of the merge
+static Benchmark
+compare_benchmark(const char* name, RowKeyType type, uint64_t nkeys,
+                  bool interned) {
+  return { name, [type, nkeys, interned]() {
+            auto texts = std::make_shared<std::vector<std::string> >(
+                make_keys(type, nkeys));
+            auto keys = std::make_shared<std::vector<TypedKey> >();
+            symbol_table.set_enabled(interned);
+            for (auto& text : *texts) {
+              keys->emplace_back(type, text, RowKeySortOrderAsc);
+              auto& key = keys->back();
+              if (type == RowKeyTypeInt) {
+                key.to_int();
+              } else if (type == RowKeyTypeFloat) {
+                key.to_float();
+              } else if (interned) {
+                key.to_symbol();
+              }
+            }
+            symbol_table.set_enabled(false);
+            return Pass([texts, keys, interned]() {
+              PassResult result;
+              symbol_table.set_enabled(interned);
+              uint64_t n = 0;
+              auto& k = *keys;
+              for (size_t i = 0; i + 1 < k.size(); i++) {
+                n += k[i].small_than(&k[i + 1]);
+                n += k[i].equals(&k[i + 1]);
+                result.bytes += k[i].key.size();
+              }
+              symbol_table.set_enabled(false);
+              sink(n);
+              result.rows = k.size() - 1;
+              return result;
+            });
+          } };
+}
+
+void
+add_key_benchmarks(std::vector<Benchmark>* list) {
+  auto n = options.rows;
+  list->push_back(parse_benchmark("key/int/parse", RowKeyTypeInt, n));
+  list->push_back(parse_benchmark("key/float/parse", RowKeyTypeFloat, n));
+  list->push_back(
+      compare_benchmark("key/int/compare", RowKeyTypeInt, n, false));
+  list->push_back(
+      compare_benchmark("key/float/compare", RowKeyTypeFloat, n, false));
+  list->push_back(
+      compare_benchmark("key/string/compare", RowKeyTypeString, n, false));
+  // less than a generation of the symbol table, so no key is interned again
+  list->push_back(compare_benchmark("key/string/compare-interned",
+                                    RowKeyTypeString, n / 4, true));
+}
+
+} // namespace bench
+} // namespace filterx
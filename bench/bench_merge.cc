@@ -0,0 +1,110 @@
+#include "bench.h"
+#include "merge_kernel.h"
+#include "process.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+namespace filterx {
+namespace bench {
+
+// a step looks at all k inputs, the merge stops after this many keys so
+// every k takes about the same time
+static uint64_t
+merge_steps(int k) {
+  return std::min<uint64_t>(options.rows, options.rows * 8 / k);
+}
+
+// k files of interleaved int keys, file i holds i, i + k, i + 2k, ..., so
+// every key of the merge comes from one file and every input is looked at
+static std::vector<std::string>&
+merge_files(int k) {
+  static std::map<int, std::vector<std::string> > files;
+  auto& paths = files[k];
+  if (!paths.empty()) {
+    return paths;
+  }
+  uint64_t nkeys = std::max<uint64_t>(k * 2, merge_steps(k));
+  for (int i = 0; i < k; i++) {
+    auto lines = make_lines(nkeys / k, 3, 1, i, k);
+    char name[64];
+    snprintf(name, sizeof(name), "/merge-%d-%d.tsv", k, i);
+    paths.push_back(scratch_dir() + name);
+    write_lines(paths.back(), lines);
+  }
+  return paths;
+}
+
+// only the time of the_topest_key or MergeKernel::topest_key is counted, a
+// row is a merged key
+static Benchmark
+topest_benchmark(int k, bool kernel) {
+  char name[64];
+  snprintf(name, sizeof(name), "topest_key/k=%d/%s", k,
+           kernel ? "kernel" : "generic");
+  return { name, [k, kernel]() {
+            auto paths = &merge_files(k);
+            auto columns = std::make_shared<std::vector<uint32_t> >(
+                std::vector<uint32_t>{ 0 });
+            auto types = std::make_shared<std::vector<RowKeyType> >(
+                std::vector<RowKeyType>{ RowKeyTypeInt });
+            auto orders = std::make_shared<std::vector<RowKeySortOrder> >(
+                std::vector<RowKeySortOrder>{ RowKeySortOrderAsc });
+            std::shared_ptr<MergeKernel> merge_kernel;
+            if (kernel) {
+              merge_kernel.reset(
+                  create_merge_kernel(*columns, *types, *orders));
+            }
+            uint64_t steps = merge_steps(k);
+            return Pass([paths, columns, types, orders, merge_kernel,
+                         steps]() {
+              std::vector<Record*> records;
+              for (auto& path : *paths) {
+                auto record
+                    = new Record(path, '\t', *columns, *types, *orders);
+                record->set_count(1, INT32_MAX);
+                record->set_record_limit(-1);
+                record->buffer()->set_kernel(merge_kernel.get());
+                record->next();
+                records.push_back(record);
+              }
+              PassResult result;
+              uint64_t ticks = 0;
+              while (result.rows < steps) {
+                int c = 0;
+                auto start = stats_ticks();
+                auto top = merge_kernel
+                               ? merge_kernel->topest_key(records, &c)
+                               : the_topest_key(records, &c);
+                ticks += stats_ticks() - start;
+                if (top == nullptr) {
+                  break;
+                }
+                result.rows++;
+                for (auto record : records) {
+                  if (record->record_status == RecordStatusWaitOutput) {
+                    record->next();
+                  }
+                }
+              }
+              for (auto record : records) {
+                delete record;
+              }
+              result.seconds = ticks_to_seconds(ticks);
+              return result;
+            });
+          } };
+}
+
+void
+add_merge_benchmarks(std::vector<Benchmark>* list) {
+  for (int k : { 2, 4, 16, 64, 256, 1024, 4096 }) {
+    list->push_back(topest_benchmark(k, false));
+    list->push_back(topest_benchmark(k, true));
+  }
+}
+
+} // namespace bench
+} // namespace filterx
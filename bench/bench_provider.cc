@@ -0,0 +1,50 @@
+#include "bench.h"
+#include "data_provider.h"
+
+#include <memory>
+
+namespace filterx {
+namespace bench {
+
+// a file of 10 columns read block by block from the page cache, GB/s is of
+// the text, not of the compressed file
+static Benchmark
+provider_benchmark(const char* name, bool gzip) {
+  return { name, [gzip]() {
+            auto lines = make_lines(options.rows, 10);
+            uint64_t bytes = 0;
+            for (auto& line : lines) {
+              bytes += line.size() + 1;
+            }
+            auto path = std::make_shared<std::string>(
+                scratch_dir() + (gzip ? "/provider.tsv.gz" : "/provider.tsv"));
+            if (gzip) {
+              write_lines_gzip(*path, lines);
+            } else {
+              write_lines(*path, lines);
+            }
+            return Pass([path, bytes]() {
+              PassResult result;
+              auto provider = createDataProvider(*path);
+              while (1) {
+                auto block = provider->next_block();
+                if (block->empty()) {
+                  break;
+                }
+                result.rows += block->size();
+              }
+              delete provider;
+              result.bytes = bytes;
+              return result;
+            });
+          } };
+}
+
+void
+add_provider_benchmarks(std::vector<Benchmark>* list) {
+  list->push_back(provider_benchmark("provider/plain", false));
+  list->push_back(provider_benchmark("provider/gzip", true));
+}
+
+} // namespace bench
+} // namespace filterx
@@ -0,0 +1,41 @@
+#include "bench.h"
+#include "row.h"
+
+#include <memory>
+
+namespace filterx {
+namespace bench {
+
+// Row::split over lines of ncolumns columns, set_row copies the line like
+// RowBuffer::add_row does
+static Benchmark
+split_benchmark(const char* name, int ncolumns, uint64_t nrows) {
+  return { name, [ncolumns, nrows]() {
+            auto lines = std::make_shared<std::vector<std::string> >(
+                make_lines(nrows, ncolumns));
+            auto row = std::make_shared<Row>();
+            row->set_separator('\t');
+            return Pass([lines, row]() {
+              PassResult result;
+              uint64_t fields = 0;
+              for (auto& line : *lines) {
+                row->set_row(line);
+                row->split();
+                fields += row->size();
+                result.bytes += line.size() + 1;
+              }
+              sink(fields);
+              result.rows = lines->size();
+              return result;
+            });
+          } };
+}
+
+void
+add_row_benchmarks(std::vector<Benchmark>* list) {
+  list->push_back(split_benchmark("split/narrow", 5, options.rows));
+  list->push_back(split_benchmark("split/wide", 100, options.rows / 16));
+}
+
+} // namespace bench
+} // namespace filterx
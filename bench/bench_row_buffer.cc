@@ -0,0 +1,67 @@
+#include "bench.h"
+#include "merge_kernel.h"
+#include "row_buffer.h"
+
+#include <memory>
+
+namespace filterx {
+namespace bench {
+
+// RowBuffer::add_row over sorted lines of 10 columns, with group_size rows
+// per key, consumed group by group like Record does
+static Benchmark
+add_row_benchmark(const char* name, RowKeyType type, int group_size,
+                  bool kernel) {
+  return { name, [type, group_size, kernel]() {
+            auto lines = std::make_shared<std::vector<std::string> >(
+                make_lines(options.rows, 10, group_size));
+            std::vector<uint32_t> columns = { 0 };
+            std::vector<RowKeyType> types = { type };
+            std::vector<RowKeySortOrder> orders = { RowKeySortOrderAsc };
+            auto buffer
+                = std::make_shared<RowBuffer>(columns, types, orders, '\t');
+            buffer->set_limits(-1, INT32_MAX);
+            std::shared_ptr<MergeKernel> merge_kernel;
+            if (kernel) {
+              merge_kernel.reset(create_merge_kernel(columns, types, orders));
+              buffer->set_kernel(merge_kernel.get());
+            }
+            return Pass([lines, buffer, merge_kernel]() {
+              PassResult result;
+              uint64_t groups = 0;
+              uint32_t n = 0;
+              for (auto& line : *lines) {
+                if (!buffer->add_row(line, n++)) {
+                  buffer->finish_group();
+                  buffer->consume();
+                  groups++;
+                }
+                result.bytes += line.size() + 1;
+              }
+              buffer->finish_group();
+              buffer->consume();
+              sink(groups);
+              result.rows = lines->size();
+              return result;
+            });
+          } };
+}
+
+void
+add_row_buffer_benchmarks(std::vector<Benchmark>* list) {
+  list->push_back(add_row_benchmark("add_row/string/group1/generic",
+                                    RowKeyTypeString, 1, false));
+  list->push_back(add_row_benchmark("add_row/string/group1/kernel",
+                                    RowKeyTypeString, 1, true));
+  list->push_back(add_row_benchmark("add_row/string/group16/generic",
+                                    RowKeyTypeString, 16, false));
+  list->push_back(add_row_benchmark("add_row/string/group16/kernel",
+                                    RowKeyTypeString, 16, true));
+  list->push_back(add_row_benchmark("add_row/int/group1/generic",
+                                    RowKeyTypeInt, 1, false));
+  list->push_back(add_row_benchmark("add_row/int/group1/kernel",
+                                    RowKeyTypeInt, 1, true));
+}
+
+} // namespace bench
+} // namespace filterx
@@ -3,6 +3,7 @@ const std = @import("std");
 pub fn build(b: *std.Build) void {
     const target = b.standardTargetOptions(.{});
     const mode = b.standardOptimizeOption(.{});
+    const alloc_stats = b.option(bool, "alloc-stats", "Count operator new calls per stage") orelse false;
 
     const zlib = b.addStaticLibrary(.{
         .name = "z",
@@ -46,19 +47,145 @@ pub fn build(b: *std.Build) void {
     filterx.addIncludePath(b.path("./deps/zlib"));
     filterx.linkLibCpp();
     filterx.linkLibrary(zlib);
+    if (target.result.os.tag == .linux) {
+        filterx.linkSystemLibrary("pthread");
+    }
     filterx.addCSourceFiles(.{
         .root = b.path("./src"),
+        .files = &[_][]const u8{"main.cc"},
+        .flags = &cxx_flags,
+    });
+    filterx.addCSourceFiles(.{
+        .root = b.path("./src"),
+        .files = &sources,
+        .flags = &cxx_flags,
+    });
+
+    if (alloc_stats) {
+        filterx.defineCMacro("FILTERX_ALLOC_STATS", null);
+    }
+
+    b.installArtifact(filterx);
+
+    // microbenchmarks of the parsing and merge paths, zig build bench
+    const bench = b.addExecutable(.{
+        .name = "filterx-bench",
+        .target = target,
+        .optimize = mode,
+    });
+    bench.addIncludePath(b.path("./include"));
+    bench.addIncludePath(b.path("./bench"));
+    bench.addIncludePath(b.path("./deps/zlib"));
+    bench.linkLibCpp();
+    bench.linkLibrary(zlib);
+    if (target.result.os.tag == .linux) {
+        bench.linkSystemLibrary("pthread");
+    }
+    bench.addCSourceFiles(.{
+        .root = b.path("./src"),
+        .files = &sources,
+        .flags = &cxx_flags,
+    });
+    bench.addCSourceFiles(.{
+        .root = b.path("./bench"),
         .files = &[_][]const u8{
-            "main.cc",
-            "data_provider.cc",
-            "process.cc",
-            "param.cc",
-        },
-        .flags = &[_][]const u8{
-            "-std=c++17",
-            "-O3",
+            "bench.cc",
+            "bench_row.cc",
+            "bench_key.cc",
+            "bench_row_buffer.cc",
+            "bench_merge.cc",
+            "bench_provider.cc",
+            "bench_alloc.cc",
         },
+        .flags = &cxx_flags,
     });
+    if (alloc_stats) {
+        bench.defineCMacro("FILTERX_ALLOC_STATS", null);
+    }
+    const bench_step = b.step("bench", "Build and run filterx-bench");
+    const run_bench = b.addRunArtifact(bench);
+    if (b.args) |args| {
+        run_bench.addArgs(args);
+    }
+    bench_step.dependOn(&run_bench.step);
+    // zig build alloc-check -Dalloc-stats=true fails if the merge allocates
+    // per row
+    const alloc_check_step = b.step("alloc-check", "Check that the merge does not allocate per row");
+    const run_alloc_check = b.addRunArtifact(bench);
+    run_alloc_check.addArg("--check-allocs");
+    alloc_check_step.dependOn(&run_alloc_check.step);
 
-    b.installArtifact(filterx);
+    // sorted input generator and end to end scaling runs, zig build gen and
+    // zig build harness
+    const gen = b.addExecutable(.{
+        .name = "filterx-gen",
+        .target = target,
+        .optimize = mode,
+    });
+    const harness = b.addExecutable(.{
+        .name = "filterx-harness",
+        .target = target,
+        .optimize = mode,
+    });
+    for ([_]*std.Build.Step.Compile{ gen, harness }) |tool| {
+        tool.addIncludePath(b.path("./tools"));
+        tool.addIncludePath(b.path("./deps/zlib"));
+        tool.linkLibCpp();
+        tool.linkLibrary(zlib);
+        tool.addCSourceFiles(.{
+            .root = b.path("./tools"),
+            .files = &[_][]const u8{"generator.cc"},
+            .flags = &cxx_flags,
+        });
+    }
+    gen.addCSourceFiles(.{
+        .root = b.path("./tools"),
+        .files = &[_][]const u8{"gen.cc"},
+        .flags = &cxx_flags,
+    });
+    harness.addCSourceFiles(.{
+        .root = b.path("./tools"),
+        .files = &[_][]const u8{"harness.cc"},
+        .flags = &cxx_flags,
+    });
+    const gen_step = b.step("gen", "Build and run filterx-gen");
+    const run_gen = b.addRunArtifact(gen);
+    if (b.args) |args| {
+        run_gen.addArgs(args);
+    }
+    gen_step.dependOn(&run_gen.step);
+    const harness_step = b.step("harness", "Build and run filterx-harness");
+    const run_harness = b.addRunArtifact(harness);
+    run_harness.addArg("--filterx");
+    run_harness.addArtifactArg(filterx);
+    if (b.args) |args| {
+        run_harness.addArgs(args);
+    }
+    harness_step.dependOn(&run_harness.step);
 }
+
+// sources shared by filterx and filterx-bench
+const sources = [_][]const u8{
+    "data_provider.cc",
+    "process.cc",
+    "param.cc",
+    "output_pipeline.cc",
+    "memory_governor.cc",
+    "cache.cc",
+    "symbol_table.cc",
+    "merge_kernel.cc",
+    "file_source.cc",
+    "stats.cc",
+    "progress.cc",
+    "perf_counters.cc",
+    "trace.cc",
+    "alloc_stats.cc",
+    "contig_order.cc",
+    "vcf.cc",
+    "bcf.cc",
+};
+
+const cxx_flags = [_][]const u8{
+    "-std=c++17",
+    "-O3",
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "row.h"
+
+namespace filterx {
+
+enum AggregateType {
+  AggregateTypeCount = 1 << 0,
+  AggregateTypeSum = 1 << 1,
+  AggregateTypeMin = 1 << 2,
+  AggregateTypeMax = 1 << 3,
+};
+
+struct AggregateSpec {
+  AggregateType type;
+  // column index starts from 0, unused by count
+  int column;
+};
+
+// statistics of one column over the rows of a key group, updated while rows
+// are grouped, so they cover rows that are not stored as well
+class AggregateColumn {
+public:
+  AggregateColumn(int column) : column(column) {}
+
+  void
+  reset() {
+    this->n = 0;
+    this->sum = 0;
+    this->min = 0;
+    this->max = 0;
+  }
+
+  void
+  add(Row* row) {
+    auto item = row->get_item(this->column);
+    if (!item.has_value()) {
+      return;
+    }
+    // items are followed by '\0' after the row is splited
+    char* end = nullptr;
+    double v = strtod(item.value().data(), &end);
+    if (end != item.value().data() + item.value().size()) {
+      return;
+    }
+    if (this->n == 0 || v < this->min) {
+      this->min = v;
+    }
+    if (this->n == 0 || v > this->max) {
+      this->max = v;
+    }
+    this->sum += v;
+    this->n++;
+  }
+
+  // append the value of type, false if the group has no numeric value
+  bool
+  format(AggregateType type, std::string* output_buffer) {
+    if (this->n == 0) {
+      return false;
+    }
+    double v = this->sum;
+    if (type == AggregateTypeMin) {
+      v = this->min;
+    } else if (type == AggregateTypeMax) {
+      v = this->max;
+    }
+    char buff[32];
+    int len = snprintf(buff, sizeof(buff), "%.15g", v);
+    output_buffer->append(buff, len);
+    return true;
+  }
+
+  int column;
+
+private:
+  size_t n = 0;
+  double sum = 0;
+  double min = 0;
+  double max = 0;
+};
+
+} // namespace filterx
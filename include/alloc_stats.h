@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+namespace filterx {
+
+// builds with FILTERX_ALLOC_STATS replace operator new to count every heap
+// allocation, in total and by the stage of the calling thread with --stats.
+// other builds count nothing
+#ifdef FILTERX_ALLOC_STATS
+static const bool ALLOC_STATS = true;
+#else
+static const bool ALLOC_STATS = false;
+#endif
+
+struct AllocCounts {
+  uint64_t calls = 0;
+  uint64_t bytes = 0;
+};
+
+// allocations of all threads since the start
+AllocCounts alloc_total();
+
+#ifdef FILTERX_ALLOC_STATS
+// where the allocations of the calling thread are counted, set by
+// StageClock, nullptr outside any stage
+extern thread_local AllocCounts* alloc_stage_counts;
+#endif
+
+} // namespace filterx
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "data_provider.h"
+
+namespace filterx {
+
+// true if head, plain or the first bytes of a gzip (BGZF) file, is a BCF2
+// file
+bool is_bcf_file(const char* head, size_t size);
+
+// reads BCF2, plain or BGZF compressed, as VCF text. the header is handed out
+// as comment lines, then one line per record. a record is turned into text
+// only up to the last column that is used, and the columns before it that
+// are not used are written as '.', so samples that are not read are never
+// decoded
+class BcfDataProvider : public DataProvider {
+public:
+  ~BcfDataProvider() override;
+  bool open(const std::string& path) override;
+  // reads from an opened file, the provider owns it
+  void attach(FileSource* source);
+  void close() override;
+  LineBlock* next_block() override;
+
+  uint64_t
+  bytes_read() override {
+    return this->raw ? this->raw->bytes_read() : 0;
+  }
+
+  uint64_t
+  total_bytes() override {
+    return this->raw ? this->raw->total_bytes() : 0;
+  }
+
+  // the column is read, every column is read until this is called. a VCF
+  // field column reads the INFO column or its sample column
+  void use_column(int column);
+  void use_all_columns();
+
+  // contig index and POS of the line n of the last block, read from the
+  // binary record, so keys on them need no parsing
+  int32_t
+  line_contig(size_t n) {
+    return this->line_contigs[n];
+  }
+
+  int64_t
+  line_position(size_t n) {
+    return this->line_positions[n];
+  }
+
+  const std::string&
+  contig_name(int32_t contig) {
+    return this->contigs[contig];
+  }
+
+protected:
+  size_t
+  read_raw(char*, size_t) override {
+    return 0;
+  }
+
+private:
+  // a typed value: type, number of values and the first value
+  struct Typed {
+    int type;
+    uint32_t count;
+    const uint8_t* data;
+  };
+
+  void read_header();
+  void add_header_line(std::string_view line);
+  // makes size bytes of the input available at input_pos, false at the end
+  // of input
+  bool fill(size_t size);
+  void read_typed(const uint8_t** p, const uint8_t* end, Typed* typed);
+  int64_t read_typed_int(const uint8_t** p, const uint8_t* end);
+  void append_record(const uint8_t* shared, uint32_t l_shared,
+                     const uint8_t* indiv, uint32_t l_indiv);
+  // text is written to size bytes reserved at its end, commit_text drops
+  // the bytes after end
+  char* reserve_text(size_t size);
+  void commit_text(char* end);
+  void append_values(Typed& typed);
+  void corrupt();
+
+  DataProvider* raw = nullptr;
+  std::string path;
+  std::string input;
+  size_t input_pos = 0;
+  bool input_eof = false;
+
+  bool header_read = false;
+  std::string header;
+  size_t header_pos = 0;
+  // FILTER, INFO and FORMAT ids, contig names and samples of the header
+  std::vector<std::string> strings;
+  std::unordered_map<std::string, int> string_ids;
+  std::vector<bool> info_flags;
+  std::vector<std::string> contigs;
+  std::vector<std::string> samples;
+  // id of GT, its values are alleles
+  int genotype_key = -1;
+
+  // columns used, all columns if all_columns is set. keep_all is set once
+  // all columns are asked for
+  bool all_columns = true;
+  bool keep_all = false;
+  std::vector<bool> columns;
+  // samples of FORMAT fields, their columns are known after the header
+  std::vector<std::string> sample_names;
+
+  // fields of the record being written
+  std::vector<Typed> alleles;
+  std::vector<std::pair<int, Typed> > infos;
+  std::vector<std::pair<int, Typed> > formats;
+
+  std::string text;
+  std::vector<size_t> line_ends;
+  std::vector<int32_t> line_contigs;
+  std::vector<int64_t> line_positions;
+};
+
+} // namespace filterx
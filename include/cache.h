@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "data_provider.h"
+#include "row.h"
+
+namespace filterx {
+
+// a cache file holds an input splited, keyed and grouped already, so queries
+// with the same keys read rows without parsing any text.
+// layout, every section starts at a multiple of 8 bytes:
+//   CacheHeader
+//   CacheKeySpec[nkeys]
+//   CacheRow[nrows]
+//   uint32_t field index[nindex]  splited rows' separator index, in order
+//   KeyValue[nrows * nkeys]       parsed numeric keys
+//   uint64_t groups[ngroups + 1]  first row of each group, then nrows
+//   char text[text_size]          splited rows, each ends with '\0'
+//   char comments[comment_size]   comment lines of the input
+// numbers use the byte order of the machine the cache was built on
+static const char CACHE_MAGIC[8] = { 'F', 'X', 'C', 'A', 'C', 'H', 'E', '1' };
+static const uint32_t CACHE_VERSION = 1;
+static const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t nkeys;
+  char separator;
+  char comment;
+  char reserved[2];
+  uint64_t nrows;
+  uint64_t ngroups;
+  uint64_t nindex;
+  uint64_t text_size;
+  uint64_t comment_size;
+  uint64_t keys_offset;
+  uint64_t rows_offset;
+  uint64_t index_offset;
+  uint64_t values_offset;
+  uint64_t groups_offset;
+  uint64_t text_offset;
+  uint64_t comment_offset;
+  uint64_t file_size;
+};
+
+struct CacheKeySpec {
+  uint32_t column;
+  uint32_t type;
+  uint32_t order;
+  uint32_t reserved;
+};
+
+struct CacheRow {
+  uint64_t text_offset;
+  uint64_t index_offset;
+  uint32_t text_length;
+  uint32_t nindex;
+  uint32_t line_number;
+  // bit i is set if the value of key i is parsed
+  uint32_t cached_keys;
+};
+
+class CacheDataProvider : public DataProvider {
+public:
+  ~CacheDataProvider() override;
+
+  bool open(const std::string& path) override;
+  void close() override;
+  // rows as text, for queries that do not use the keys of the cache. comment
+  // lines come first
+  LineBlock* next_block() override;
+  uint64_t bytes_read() override;
+
+  uint64_t
+  total_bytes() override {
+    return this->size;
+  }
+
+  // rows can be read by group only if the query splits and keys rows the
+  // same way as the cache
+  bool matches(char separator, std::vector<uint32_t>& row_keys,
+               std::vector<RowKeyType>& key_types,
+               std::vector<RowKeySortOrder>& sort_order);
+  // rows [begin, end) of the next group, false at the end of the cache
+  bool next_group(uint64_t* begin, uint64_t* end);
+  void load_row(uint64_t n, Row* row);
+
+protected:
+  size_t
+  read_raw(char*, size_t) override {
+    return 0;
+  }
+
+private:
+  bool check_layout();
+
+  const char* data = nullptr;
+  size_t size = 0;
+  bool mapped = false;
+  std::vector<char> content;
+
+  const CacheHeader* header = nullptr;
+  const CacheKeySpec* keys = nullptr;
+  const CacheRow* rows = nullptr;
+  const uint32_t* index = nullptr;
+  const KeyValue* values = nullptr;
+  const uint64_t* groups = nullptr;
+  const char* text = nullptr;
+  const char* comments = nullptr;
+
+  std::string lines_text;
+  uint64_t next_group_idx = 0;
+  uint64_t next_row = 0;
+  uint64_t comment_pos = 0;
+};
+
+bool is_cache_file(const char* head, size_t size);
+
+// filterx cache build [-o <output>] <file:attributes>
+int cache_main(int argc, char** argv);
+
+} // namespace filterx
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace filterx {
+
+// ranks of the contigs of a reference, so CHROM is ordered like the sorted
+// VCF and not by its text. the order is read from the ##contig header lines
+// of the inputs, or from the file given with --contigs (a .fai, a VCF or SAM
+// header, or one contig per line). ranks never change once given: contigs of
+// a later header are appended, and must keep the order of the known ones
+class ContigOrder {
+public:
+  // the order of path is used, header lines of the inputs are ignored
+  void load(const std::string& path);
+
+  // line is a header line of path, last is the rank of the previous
+  // ##contig line of that file, -1 before the first one
+  void add_header_line(std::string_view line, int64_t* last,
+                       const std::string& path);
+
+  int64_t
+  rank(std::string_view name) {
+    if (this->last_valid && name == this->last_name) {
+      return this->last_rank;
+    }
+    auto it = this->ranks.find(name);
+    if (it == this->ranks.end()) {
+      this->unknown(name);
+      return -1;
+    }
+    this->last_valid = true;
+    this->last_name = it->first;
+    this->last_rank = it->second;
+    return it->second;
+  }
+
+private:
+  // rank of name, appended if it is new
+  int64_t add(std::string_view name);
+  void unknown(std::string_view name);
+
+  bool loaded = false;
+  // names are kept in a deque so the views of the map stay valid
+  std::deque<std::string> names;
+  std::unordered_map<std::string_view, int64_t> ranks;
+  bool last_valid = false;
+  std::string_view last_name;
+  int64_t last_rank = 0;
+};
+
+extern ContigOrder contig_order;
+
+// the ID of a ##contig=<ID=...> line, empty for other lines
+std::string_view contig_header_id(std::string_view line);
+
+} // namespace filterx
@@ -1,63 +1,200 @@
 #pragma once
 
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
-#include <fstream>
 #include <iostream>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
+#include "file_source.h"
+#include "memory_governor.h"
 #include "zlib.h"
 
 namespace filterx {
 
+// non-empty lines read at once, without their newline. the views are valid
+// until the next block is read
+struct LineBlock {
+  std::vector<std::string_view> lines;
+  std::vector<uint32_t> line_numbers;
+
+  size_t
+  size() {
+    return this->lines.size();
+  }
+
+  bool
+  empty() {
+    return this->lines.empty();
+  }
+
+  void
+  clear() {
+    this->lines.clear();
+    this->line_numbers.clear();
+  }
+
+  void
+  push(std::string_view line, uint32_t line_number) {
+    this->lines.push_back(line);
+    this->line_numbers.push_back(line_number);
+  }
+};
+
+// input is read in large chunks and splited into blocks of lines, a
+// provider only reads raw bytes
 class DataProvider {
 public:
-  std::string line;
   uint32_t line_number = 0;
-
   bool eof = false;
-  DataProvider() { line.reserve(1024); }
+  MemoryAccount memory{ MemoryDataProvider };
+
+  DataProvider() = default;
   virtual ~DataProvider() = default;
 
   virtual bool open(const std::string& path) = 0;
-  virtual std::optional<std::string_view> readline() = 0;
   virtual void close() = 0;
+  // an empty block at the end of input
+  virtual LineBlock* next_block();
+
+  // one line at a time over the blocks, line_number is the number of the
+  // returned line
+  std::optional<std::string_view> readline();
+
+  // bytes of the input file read so far, compressed bytes for gzip
+  virtual uint64_t
+  bytes_read() {
+    return 0;
+  }
+
+  // size of the input in the unit of bytes_read, 0 if it is not known
+  virtual uint64_t
+  total_bytes() {
+    return 0;
+  }
+
+  // the file read by the provider, nullptr if it does not read one file
+  virtual FileSource*
+  file_source() {
+    return nullptr;
+  }
+
+protected:
+  friend class ShardDataProvider;
+  friend class BcfDataProvider;
+
+  // reads up to size bytes, 0 at the end of input
+  virtual size_t read_raw(char* buffer, size_t size) = 0;
+
+  LineBlock block;
+
+private:
+  std::string buffer;
+  // start of the data not handed out yet in buffer
+  size_t start = 0;
+  bool raw_eof = false;
+  size_t raw_bytes = 0;
+  size_t readline_pos = 0;
 };
 
 class PlainDataProvider : public DataProvider {
-
 public:
   ~PlainDataProvider() override;
-
   bool open(const std::string& path) override;
-
+  // reads from an opened file, the provider owns it
+  void attach(FileSource* source);
   void close() override;
+  uint64_t bytes_read() override;
+  uint64_t total_bytes() override;
 
-  std::optional<std::string_view> readline() override;
+  FileSource*
+  file_source() override {
+    return this->source;
+  }
 
-private:
-  std::ifstream file;
-
-  std::string line;
+protected:
+  size_t read_raw(char* buffer, size_t size) override;
 
-  bool eof = false;
+private:
+  FileSource* source = nullptr;
 };
 
 class GzipDataProvider : public DataProvider {
 public:
   ~GzipDataProvider() override;
   bool open(const std::string& path) override;
+  // reads from an opened file, the provider owns it
+  void attach(FileSource* source);
+  void close() override;
+  uint64_t bytes_read() override;
+  uint64_t total_bytes() override;
+
+  FileSource*
+  file_source() override {
+    return this->source;
+  }
+
+protected:
+  size_t read_raw(char* buffer, size_t size) override;
+
+private:
+  // inflates the chunks of the source as they come, a file can hold more
+  // than one gzip member
+  FileSource* source = nullptr;
+  z_stream stream;
+  bool stream_init = false;
+  bool stream_end = false;
+};
+
+// shards:<pattern>[,<pattern>...] is one input made of the files matching
+// the patterns, read one after the other. the files of a pattern are in
+// natural order, so chr2 comes before chr10 and part-9 before part-10
+static const char SHARDS_PREFIX[] = "shards:";
+
+class ShardDataProvider : public DataProvider {
+public:
+  ~ShardDataProvider() override;
+  bool open(const std::string& path) override;
   void close() override;
-  std::optional<std::string_view> readline() override;
+  uint64_t bytes_read() override;
+  uint64_t total_bytes() override;
+
+protected:
+  size_t read_raw(char* buffer, size_t size) override;
 
 private:
-  gzFile file;
-  std::string decompressed_buff;
-  char buff[1024];
+  // the first bytes of a shard are read on another thread while the shard
+  // before it is read
+  struct Prefetch {
+    std::thread thread;
+    DataProvider* provider = nullptr;
+    std::string head;
+  };
+
+  void start_prefetch();
+  bool next_shard();
+
+  std::vector<std::string> paths;
+  size_t next = 0;
+  DataProvider* current = nullptr;
+  // bytes of the shards read already
+  uint64_t shard_bytes = 0;
+  std::string head;
+  size_t head_pos = 0;
+  // last byte of the current shard, a shard without a newline at its end
+  // gets one so its last line is not joined with the next shard
+  char last_byte = '\n';
+  Prefetch prefetch;
+  MemoryAccount head_memory{ MemoryDataProvider };
 };
 
-DataProvider* createDataProvider(const std::string& path);
+bool is_shards_path(const std::string& path);
+
+// pooled is false for files opened on threads other than the reading one
+DataProvider* createDataProvider(const std::string& path, bool pooled = true);
 
 } // namespace filterx
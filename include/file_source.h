@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "memory_governor.h"
+
+namespace filterx {
+
+enum IoMode {
+  IoModeSync = 0,
+  IoModeUring = 1,
+};
+
+// raw bytes of an input file, handed out in chunks. only the files read
+// recently keep their descriptor open, see FdPool
+class FileSource {
+public:
+  std::string path;
+  // bytes of the file read so far, a closed file is opened again there
+  uint64_t offset = 0;
+
+  virtual ~FileSource();
+
+  // the first bytes of the file, to tell its format. they are handed out
+  // again by the reads
+  std::string_view head();
+  // next chunk of the file, valid until the next call, false at the end
+  bool next_chunk(const char** data, size_t* size);
+  // copies up to size bytes, 0 at the end
+  virtual size_t read(char* buffer, size_t size);
+
+  // closes the descriptor, it is opened again on the next read
+  virtual void release() = 0;
+
+  // a file opened on another thread stays out of the pool until it is
+  // handed to the reading thread, so the pool is only used by one thread
+  void set_pooled(bool pooled);
+
+protected:
+  virtual bool read_chunk(const char** data, size_t* size) = 0;
+  // marks the file as used, other files may be released to keep the number
+  // of open descriptors bounded
+  void touch();
+  // the end of the file is reached, its descriptor is not needed anymore
+  void finish();
+
+  // a chunk read but not handed out yet
+  const char* chunk = nullptr;
+  size_t chunk_size = 0;
+
+private:
+  friend class FdPool;
+  bool head_read = false;
+  bool use_pool = true;
+  bool pooled = false;
+  FileSource* lru_prev = nullptr;
+  FileSource* lru_next = nullptr;
+};
+
+class SyncFileSource : public FileSource {
+public:
+  ~SyncFileSource() override;
+  bool open(const std::string& path);
+  size_t read(char* buffer, size_t size) override;
+  void release() override;
+
+protected:
+  bool read_chunk(const char** data, size_t* size) override;
+
+private:
+  bool reopen();
+  void ensure_open();
+  size_t read_file(char* buffer, size_t size);
+
+  int fd = -1;
+  std::vector<char> buffer;
+  MemoryAccount memory{ MemoryDataProvider };
+};
+
+// io_uring is used once set_io_mode(IoModeUring) is called and the kernel
+// allows it, files are read synchronously otherwise
+void set_io_mode(IoMode mode);
+// nullptr if the file can not be opened, errno tells why
+FileSource* open_file_source(const std::string& path, bool pooled = true);
+// size of a file in bytes, 0 if it can not be read
+uint64_t file_size(const std::string& path);
+
+} // namespace filterx
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+namespace filterx {
+
+enum MemorySubsystem {
+  MemoryRowBuffer = 0,
+  MemoryDataProvider = 1,
+  MemoryOutput = 2,
+  MemorySymbolTable = 3,
+  MemorySubsystemCount = 4,
+};
+
+// tracks the bytes held by the big buffers of filterx, when a budget is set
+// the subsystems check it and use less memory once it is reached
+class MemoryGovernor {
+public:
+  void
+  set_budget(size_t budget) {
+    this->budget = budget;
+  }
+
+  size_t
+  get_budget() {
+    return this->budget;
+  }
+
+  void
+  add(MemorySubsystem subsystem, int64_t delta) {
+    auto now = this->current[subsystem].fetch_add(delta,
+                                                  std::memory_order_relaxed)
+               + delta;
+    update_peak(&this->peak[subsystem], now);
+    auto total = this->total.fetch_add(delta, std::memory_order_relaxed)
+                 + delta;
+    update_peak(&this->peak_total, total);
+  }
+
+  bool
+  over_budget() {
+    return this->budget > 0
+           && this->total.load(std::memory_order_relaxed)
+                  >= static_cast<int64_t>(this->budget);
+  }
+
+  void report(FILE* file);
+
+private:
+  static void
+  update_peak(std::atomic<int64_t>* peak, int64_t now) {
+    auto old = peak->load(std::memory_order_relaxed);
+    while (now > old
+           && !peak->compare_exchange_weak(old, now,
+                                           std::memory_order_relaxed)) {
+    }
+  }
+
+  size_t budget = 0;
+  std::atomic<int64_t> total{ 0 };
+  std::atomic<int64_t> peak_total{ 0 };
+  std::atomic<int64_t> current[MemorySubsystemCount] = {};
+  std::atomic<int64_t> peak[MemorySubsystemCount] = {};
+};
+
+extern MemoryGovernor memory_governor;
+
+// per object view of a subsystem, small changes are collected locally and
+// published in steps of MEMORY_ACCOUNT_STEP to keep the hot paths cheap
+static const int64_t MEMORY_ACCOUNT_STEP = 16 << 10;
+
+class MemoryAccount {
+public:
+  MemoryAccount(MemorySubsystem subsystem) : subsystem(subsystem) {}
+  ~MemoryAccount() { this->update(0); }
+
+  MemoryAccount(const MemoryAccount&) = delete;
+  MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+  void
+  update(size_t bytes) {
+    int64_t delta = static_cast<int64_t>(bytes) - this->reported;
+    if (delta >= MEMORY_ACCOUNT_STEP || delta <= -MEMORY_ACCOUNT_STEP
+        || (bytes == 0 && delta != 0)) {
+      memory_governor.add(this->subsystem, delta);
+      this->reported = bytes;
+    }
+  }
+
+private:
+  MemorySubsystem subsystem;
+  int64_t reported = 0;
+};
+
+} // namespace filterx
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "record.h"
+#include "row.h"
+
+namespace filterx {
+
+enum MergeKernelMode {
+  MergeKernelAuto = 0,
+  MergeKernelGeneric = 1,
+};
+
+// merge order of one key column, type and order are template arguments so
+// the comparison does not branch on them
+template <RowKeyType Type, RowKeySortOrder Order>
+struct KeyColumn {
+  // the parsed int, or the rank of a contig
+  static inline int64_t
+  int_value(Row* row, int index, std::string_view key) {
+    auto value = row->cached_key(index);
+    if (value != nullptr) {
+      return value->int_value;
+    }
+    KeyValue parsed;
+    if constexpr (Type == RowKeyTypeContig) {
+      parsed.int_value = contig_order.rank(key);
+    } else {
+      parsed.int_value = parse_int_key(key);
+    }
+    row->set_cached_key(index, parsed);
+    return parsed.int_value;
+  }
+
+  // negative if a comes first, 0 if the keys are equal. rows in the merge
+  // have all their keys
+  static inline int
+  compare(Row* a, Row* b, uint32_t column, int index) {
+    auto ka = a->get_item(column);
+    auto kb = b->get_item(column);
+    assert(ka.has_value() && kb.has_value());
+    int c = 0;
+    if constexpr (Type == RowKeyTypeInt || Type == RowKeyTypeContig) {
+      auto va = int_value(a, index, ka.value());
+      auto vb = int_value(b, index, kb.value());
+      c = (va > vb) - (va < vb);
+    } else {
+      c = ka.value().compare(kb.value());
+    }
+    if constexpr (Order == RowKeySortOrderDesc) {
+      return -c;
+    }
+    return c;
+  }
+
+  static inline bool
+  equals(Row* a, Row* b, uint32_t column, int index) {
+    auto ka = a->get_item(column);
+    auto kb = b->get_item(column);
+    if (!ka.has_value() || !kb.has_value()) {
+      return false;
+    }
+    if constexpr (Type == RowKeyTypeInt) {
+      return int_value(a, index, ka.value())
+             == int_value(b, index, kb.value());
+    }
+    return ka.value() == kb.value();
+  }
+};
+
+// picks the records holding the next key of the merge and tells whether two
+// rows of a file belong to the same group, the generic path does the same
+// through RowKey and TypedKey
+class MergeKernel : public GroupKernel {
+public:
+  // the records holding the key that comes first are set to WaitOutput,
+  // returns that key
+  virtual RowKey* topest_key(std::vector<Record*>& records, int* ntop) = 0;
+};
+
+template <class... Columns>
+class ShapeKernel : public MergeKernel {
+public:
+  ShapeKernel(std::vector<uint32_t>& columns) {
+    assert(columns.size() == sizeof...(Columns));
+    for (size_t i = 0; i < sizeof...(Columns); i++) {
+      this->columns[i] = columns[i];
+    }
+  }
+
+  RowKey*
+  topest_key(std::vector<Record*>& records, int* ntop) override {
+    *ntop = 0;
+    RowKey* top = nullptr;
+    Row* top_row = nullptr;
+    for (auto r : records) {
+      if (r->record_status != RecordStatusWaitConsumption) {
+        continue;
+      }
+      auto key = front_key(r);
+      if (key == nullptr) {
+        continue;
+      }
+      if (top_row == nullptr
+          || this->compare<0, Columns...>(key->current_row(), top_row) < 0) {
+        top = key;
+        top_row = key->current_row();
+      }
+    }
+    if (top == nullptr) {
+      return nullptr;
+    }
+    for (auto r : records) {
+      if (r->record_status != RecordStatusWaitConsumption) {
+        continue;
+      }
+      auto key = r->key().value_or(nullptr);
+      if (key != nullptr
+          && this->compare<0, Columns...>(key->current_row(), top_row) == 0) {
+        r->record_status = RecordStatusWaitOutput;
+        (*ntop)++;
+      }
+    }
+    return top;
+  }
+
+  bool
+  same_key(Row* a, Row* b) override {
+    return this->equals<0, Columns...>(a, b);
+  }
+
+private:
+  // key of the first group of a record, groups without every key column
+  // are skipped by Record::next
+  static inline RowKey*
+  front_key(Record* r) {
+    while (1) {
+      auto key = r->key().value_or(nullptr);
+      if (key != nullptr) {
+        return key;
+      }
+      if (r->next() == RecordStatusEof) {
+        return nullptr;
+      }
+    }
+  }
+
+  template <int I, class Column, class... Rest>
+  inline int
+  compare(Row* a, Row* b) {
+    int c = Column::compare(a, b, this->columns[I], I);
+    if constexpr (sizeof...(Rest) > 0) {
+      if (c == 0) {
+        return this->compare<I + 1, Rest...>(a, b);
+      }
+    }
+    return c;
+  }
+
+  template <int I, class Column, class... Rest>
+  inline bool
+  equals(Row* a, Row* b) {
+    if (!Column::equals(a, b, this->columns[I], I)) {
+      return false;
+    }
+    if constexpr (sizeof...(Rest) > 0) {
+      return this->equals<I + 1, Rest...>(a, b);
+    }
+    return true;
+  }
+
+  uint32_t columns[sizeof...(Columns)];
+};
+
+// a kernel for one string, int or contig key, or a string or contig key
+// followed by an int key (like CHROM and POS), in any order. nullptr for
+// other keys, which use the generic path
+MergeKernel* create_merge_kernel(std::vector<uint32_t>& columns,
+                                 std::vector<RowKeyType>& key_types,
+                                 std::vector<RowKeySortOrder>& sort_order);
+
+} // namespace filterx
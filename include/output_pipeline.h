@@ -0,0 +1,112 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "memory_governor.h"
+#include "row.h"
+#include "spill.h"
+#include "stats.h"
+#include "trace.h"
+
+namespace filterx {
+
+// rows of one record that take part in an output group, they are moved out of
+// the record's RowBuffer so the merge can go on while the group is formatted
+struct OutputSlot {
+  bool present = false;
+  size_t nrows = 0;
+  std::vector<Row> rows;
+  std::unique_ptr<SpillFile> spill;
+  Row spilled_row;
+
+  // rows must be visited in order, spilled rows are streamed from disk
+  Row*
+  get_row(size_t n) {
+    if (n < this->rows.size()) {
+      return &this->rows[n];
+    }
+    assert(this->spill);
+    this->spill->read(&this->spilled_row);
+    return &this->spilled_row;
+  }
+};
+
+struct OutputGroup {
+  std::vector<OutputSlot> slots;
+  // memory held by the rows of the group
+  size_t memory = 0;
+};
+
+typedef std::function<void(OutputGroup*, std::string*)> GroupFormatter;
+
+struct OutputBatch {
+  uint64_t seq = 0;
+  size_t ngroups = 0;
+  size_t memory = 0;
+  bool formatted = false;
+  std::vector<OutputGroup> groups;
+  std::string text;
+};
+
+// formats output groups and writes them in key order
+// nthreads <= 1: groups are formatted by the merge thread
+// nthreads > 1: batches of groups are formatted by a pool of threads and
+// committed in the order they were submitted
+// groups with spilled rows are always formatted by the merge thread, so their
+// output is written while it is produced and never held in memory
+class OutputPipeline {
+public:
+  OutputPipeline(FILE* output_file, int nthreads, GroupFormatter formatter);
+  ~OutputPipeline();
+
+  OutputGroup* next_group(size_t nslots);
+  void commit_group(bool spilled = false);
+  void flush_if_full(std::string* output_buffer);
+  // buffer written by the merge thread directly, for output that needs no
+  // formatting stage
+  std::string* direct_buffer();
+  void finish();
+
+private:
+  void submit_current_batch();
+  void wait_committed();
+  void worker();
+  void write_ready_batches(std::unique_lock<std::mutex>& lock);
+  void write_text(std::string* text);
+
+  FILE* output_file;
+  GroupFormatter formatter;
+  int nthreads;
+  bool finished = false;
+
+  // inline mode
+  OutputGroup group;
+  std::string buffer;
+  MemoryAccount buffer_memory{ MemoryOutput };
+
+  // threaded mode
+  std::mutex mutex;
+  std::condition_variable work_cv;
+  std::condition_variable free_cv;
+  std::condition_variable done_cv;
+  std::vector<std::thread> workers;
+  std::vector<OutputBatch*> all_batches;
+  std::vector<OutputBatch*> free_batches;
+  std::deque<OutputBatch*> work_queue;
+  std::deque<OutputBatch*> commit_queue;
+  OutputBatch* current = nullptr;
+  uint64_t next_seq = 0;
+  bool writer_active = false;
+  bool stop = false;
+};
+
+} // namespace filterx
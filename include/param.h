@@ -3,9 +3,13 @@
 #include <cstdint>
 #include <iostream>
 #include <string>
+#include <tuple>
 #include <vector>
 
+#include "file_source.h"
+#include "merge_kernel.h"
 #include "record.h"
+#include "stats.h"
 #include "row.h"
 
 namespace filterx {
@@ -22,6 +26,7 @@ struct GroupParams {
   int max_count;
   char comment;
   char placehoder;
+  RowRank rank;
 };
 
 struct FileParams {
@@ -37,6 +42,7 @@ struct FileParams {
   int max_count;
   char comment;
   char placehoder;
+  RowRank rank;
 };
 
 static void
@@ -71,6 +77,12 @@ print_file_params(FileParams* file_params) {
   std::cout << "placehoder: " << file_params->placehoder << std::endl;
 }
 
+enum BitmapFormat {
+  BitmapFormatNone = 0,
+  BitmapFormatHex = 1,
+  BitmapFormatBase64 = 2,
+};
+
 struct ProcessorParams {
   uint32_t min_count;
   uint32_t max_count;
@@ -81,6 +93,23 @@ struct ProcessorParams {
   char output_separator;
   bool row_mode;
   bool full_mode;
+  int threads;
+  size_t spill_size;
+  size_t max_memory;
+  std::vector<AggregateSpec> aggregates;
+  BitmapFormat bitmap;
+  bool intern;
+  MergeKernelMode kernel;
+  IoMode io_mode;
+  StatsFormat stats;
+  // hardware counters of every stage in the --stats report
+  bool counters;
+  // seconds between progress reports, 0 reports only on SIGUSR1
+  double progress;
+  // chrome trace written at exit, empty for none
+  std::string trace_path;
+  // order of contig keys, empty to read it from the ##contig lines
+  std::string contigs_path;
 };
 
 extern ProcessorParams defaultProcessorParams;
@@ -89,6 +118,7 @@ typedef std::vector<std::tuple<int, filterx::GroupParams> > GroupParamsList;
 typedef std::vector<filterx::FileParams> FileParamsList;
 
 Record* create_record_from_file_param(FileParams* params);
+FileParams parse_cache_file_params(const char* arg);
 void parse(int argc, char** argv, GroupParamsList* group_params_list,
            FileParamsList* file_params_list, ProcessorParams* processor_params);
 
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace filterx {
+
+enum Counter {
+  CounterCycles = 0,
+  CounterInstructions = 1,
+  CounterBranchMisses = 2,
+  CounterLlcMisses = 3,
+  CounterCount = 4,
+};
+
+extern const char* COUNTER_NAMES[CounterCount];
+
+// hardware counters of the calling thread, from perf_event_open on Linux.
+// the counters are read with rdpmc where the kernel allows it, so they can be
+// read around short pieces of work, and with one read() otherwise
+class PerfCounters {
+public:
+  PerfCounters() = default;
+  ~PerfCounters();
+
+  // false if the kernel or the platform does not give the counters, error
+  // tells why
+  bool open(std::string* error);
+  void close();
+  // counts since open, a counter that could not be opened stays 0
+  void read(uint64_t values[CounterCount]);
+
+  // the counters can be read without a system call
+  bool fast();
+
+  // a counter the cpu does not have, e.g. llc misses in some vms
+  bool
+  has(int counter) {
+    return this->fds[counter] >= 0;
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+private:
+  bool read_mapped(uint64_t values[CounterCount]);
+
+  int fds[CounterCount] = { -1, -1, -1, -1 };
+  // the mmap page of every counter, for rdpmc
+  void* pages[CounterCount] = {};
+  // position of every open counter in a group read
+  int slots[CounterCount] = {};
+  int nopen = 0;
+};
+
+} // namespace filterx
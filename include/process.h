@@ -1,3 +1,6 @@
+#pragma once
+
+#include "output_pipeline.h"
 #include "param.h"
 #include "record.h"
 
@@ -7,10 +10,13 @@ class Processor {
 public:
   Processor(ProcessorParams& params);
   ~Processor() {
+    delete this->pipeline;
     for (auto record : this->records) {
       delete record;
     }
+    delete this->kernel;
     if (this->output_file == stdout) {
+      fflush(this->output_file);
       return;
     }
     if (this->output_file != nullptr) {
@@ -19,18 +25,32 @@ public:
       this->output_file = nullptr;
     }
   }
+  void select_kernel(FileParams* params);
   void add_record(Record* record);
   void prepare();
   void flush_all_records_to_file();
-  void flush_all_records_to_file_row_mode();
+  void format_column_mode(OutputGroup* group, std::string* output_buffer);
+  void format_row_mode(OutputGroup* group, std::string* output_buffer);
+  void flush_aggregate();
+  void flush_bitmap();
   void drop_all_records_and_update_next();
   void process();
+  void report_stats(FILE* file);
 
 private:
-  std::string output_buffer;
+  void append_key(std::string* output_buffer);
+  void write_progress_keys();
+
   FILE* output_file;
+  std::vector<uint8_t> bitmap;
+  OutputPipeline* pipeline = nullptr;
+  MergeKernel* kernel = nullptr;
   std::vector<Record*> records;
   ProcessorParams params;
 };
 
+// the records holding the key that comes first are set to WaitOutput,
+// returns that key. the generic path of MergeKernel::topest_key
+RowKey* the_topest_key(std::vector<Record*>& records, int* ntop);
+
 } // namespace filterx
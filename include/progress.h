@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace filterx {
+
+// where the merge is in one input. the counters are written by the merge
+// thread and read by the progress reporter without a lock
+struct RecordProgress {
+  std::atomic<uint64_t> bytes{ 0 };
+  std::atomic<uint64_t> groups{ 0 };
+  std::atomic<bool> eof{ false };
+  // size of the input, 0 if it is not known
+  uint64_t size = 0;
+  // key of the current group, written by the merge thread under
+  // Progress::mutex when a report asks for it
+  std::string key;
+};
+
+// reports the progress of every input to stderr every interval seconds with
+// --progress, and once on SIGUSR1 where there is one
+class Progress {
+public:
+  ~Progress() { this->stop(); }
+
+  void add(const std::string& path, RecordProgress* record);
+  // interval 0 reports only on SIGUSR1
+  void start(double interval);
+  void stop();
+
+  // a report waits for the keys of the records, checked by the merge thread
+  // after every group
+  bool
+  wanted() {
+    return this->keys_wanted.load(std::memory_order_relaxed);
+  }
+
+  // called by the merge thread with mutex held once the keys are written
+  void keys_written();
+
+  std::mutex mutex;
+
+private:
+  struct Entry {
+    std::string path;
+    RecordProgress* record;
+  };
+
+  void run();
+  void report(std::unique_lock<std::mutex>& lock);
+
+  std::vector<Entry> entries;
+  std::thread thread;
+  std::condition_variable cv;
+  std::atomic<bool> keys_wanted{ false };
+  bool stopping = false;
+  double interval = 0;
+  std::chrono::steady_clock::time_point start_time;
+};
+
+extern Progress progress;
+
+} // namespace filterx
@@ -1,10 +1,17 @@
 #pragma once
 
+#include <memory>
 #include <optional>
 #include <string>
 
+#include "bcf.h"
+#include "cache.h"
 #include "data_provider.h"
+#include "progress.h"
 #include "row_buffer.h"
+#include "stats.h"
+#include "trace.h"
+#include "vcf.h"
 
 namespace filterx {
 
@@ -33,10 +40,34 @@ public:
          std::optional<char> comment = std::nullopt)
       : row_buffer(row_keys, key_types, sort_order, separator), path(path) {
     this->data_provider = createDataProvider(path);
+    // a cache built with the same keys is read group by group
+    auto cache = dynamic_cast<CacheDataProvider*>(this->data_provider);
+    if (cache != nullptr
+        && cache->matches(separator, row_keys, key_types, sort_order)) {
+      this->cache = cache;
+    }
+    this->bcf = dynamic_cast<BcfDataProvider*>(this->data_provider);
+    // POS int keys and CHROM contig keys of a BCF are taken from the binary
+    // record
+    for (int i = 0; i < row_keys.size() && i < ROW_KEY_CACHE_SIZE; i++) {
+      if (this->bcf != nullptr && row_keys[i] == 0
+          && key_types[i] == RowKeyTypeContig) {
+        this->bcf_contig_keys |= 1u << i;
+      }
+      if (this->bcf != nullptr && row_keys[i] == 1
+          && key_types[i] == RowKeyTypeInt) {
+        this->bcf_position_keys |= 1u << i;
+      }
+    }
     this->min_count = 1;
     this->max_count = INT32_MAX;
     this->must_exist = ExistConditionOptional;
     this->cut_columns = std::vector<int>();
+    for (auto type : key_types) {
+      if (type == RowKeyTypeContig) {
+        this->contig_keys = true;
+      }
+    }
   }
   Record(std::string& path, char separator, std::vector<uint32_t>& row_keys,
          std::vector<RowKeyType>& key_types,
@@ -67,6 +98,43 @@ public:
     }
     this->min_count = min_count;
     this->max_count = max_count;
+    this->row_buffer.set_limits(this->record_limit, this->max_count);
+  }
+
+  // only the columns given are turned into text when a BCF file is read,
+  // every column if none is given. rows with VCF fields are split up to the
+  // last column given
+  void
+  read_column(int column) {
+    if (this->bcf != nullptr) {
+      this->bcf->use_column(column);
+    }
+    if (this->vcf != nullptr) {
+      this->vcf->use(column);
+    }
+  }
+
+  void
+  read_all_columns() {
+    if (this->bcf != nullptr) {
+      this->bcf->use_all_columns();
+    }
+    if (this->vcf != nullptr) {
+      this->vcf->use_all_columns();
+    }
+  }
+
+  // rows get the VCF fields named by the keys and cut columns
+  void
+  set_vcf_fields(std::vector<uint32_t>& keys, std::vector<int>& columns) {
+    auto layout = std::make_unique<VcfLayout>(keys, columns);
+    if (layout->empty()) {
+      return;
+    }
+    this->vcf = std::move(layout);
+    this->row_buffer.set_extractor(this->vcf.get());
+    // the fields are not in a cache, its rows are read as text
+    this->cache = nullptr;
   }
 
   RecordStatus
@@ -75,29 +143,26 @@ public:
     if (this->record_status == RecordStatusEof) {
       return RecordStatusEof;
     }
+    StageScope scope(StageGroup);
     this->__consume();
     assert(this->record_status == RecordStatusEmpty
            || this->record_status == RecordStatusTryToReadNext
            || this->record_status == RecordStatusNotPassCondition);
-    while (1) {
-      auto line = this->data_provider->readline();
-      if (!line.has_value()) {
-        this->record_status = RecordStatusEof;
-        break;
-      }
-      if (line.value()[0] == this->comment) {
-        continue;
-      }
-      // printf("line: %s\n", line.value().data());
-      if (!this->row_buffer.add_row(const_cast<char*>(line.value().data()),
-                                    this->data_provider->line_number)) {
-        break;
-      }
+    if (this->cache != nullptr) {
+      this->read_cached_group();
+    } else {
+      this->read_group();
     }
+    this->row_buffer.finish_group();
     if (this->row_buffer.size() > 0) {
       this->record_status = RecordStatusWaitConsumption;
+      this->stats.groups++;
+      this->progress.groups.store(this->stats.groups,
+                                  std::memory_order_relaxed);
     } else {
       this->record_status = RecordStatusEof;
+      this->progress.bytes.store(this->bytes_read(), std::memory_order_relaxed);
+      this->progress.eof.store(true, std::memory_order_relaxed);
     }
     assert(this->record_status == RecordStatusWaitConsumption
            || this->record_status == RecordStatusEof);
@@ -112,10 +177,12 @@ public:
         return RecordStatusEof;
       }
       if (!this->check_count_condition()) {
+        this->stats.dropped_count++;
         continue;
       }
       auto key = this->key().value_or(nullptr);
       if (key == nullptr) {
+        this->stats.dropped_key++;
         continue;
       }
       int pass = 1;
@@ -129,6 +196,7 @@ public:
       if (pass) {
         return RecordStatusWaitConsumption;
       }
+      this->stats.dropped_key++;
     }
   }
 
@@ -176,18 +244,57 @@ public:
     return &this->row_buffer;
   }
 
+  const std::string&
+  get_path() {
+    return this->path;
+  }
+
+  uint64_t
+  bytes_read() {
+    return this->data_provider->bytes_read();
+  }
+
+  uint64_t
+  total_bytes() {
+    return this->data_provider->total_bytes();
+  }
+
+  // key of the current group for a progress report, called by the merge
+  // thread
+  void
+  write_progress_key(char separator) {
+    auto& text = this->progress.key;
+    text.clear();
+    if (this->record_status == RecordStatusEof) {
+      return;
+    }
+    auto key = this->key().value_or(nullptr);
+    if (key == nullptr) {
+      return;
+    }
+    for (int i = 0; i < key->size(); i++) {
+      auto k = key->get_key(i).value_or(nullptr);
+      if (k == nullptr) {
+        continue;
+      }
+      if (!text.empty()) {
+        text.push_back(separator);
+      }
+      text.append(k->to_string());
+    }
+  }
+
   void
   set_record_limit(int limit) {
     this->record_limit = limit;
+    this->row_buffer.set_limits(this->record_limit, this->max_count);
   }
 
   int
   get_record_limit() {
-    if (this->record_limit == -1) {
-      return this->row_buffer.size();
-    }
-    if (this->record_limit > this->row_buffer.size()) {
-      return this->row_buffer.size();
+    int nrows = this->row_buffer.stored();
+    if (this->record_limit == -1 || this->record_limit > nrows) {
+      return nrows;
     }
     return this->record_limit;
   }
@@ -199,14 +306,133 @@ public:
   char comment = '#';
   char placehoder = '-';
   int id;
+  FileStats stats;
+  RecordProgress progress;
 
 private:
+  // lines are taken from the current block until a line of the next group
+  // is read
+  void
+  read_group() {
+    while (1) {
+      if (this->block_pos >= this->block->size()) {
+        {
+          TraceSpan span("refill", "read", this->path.c_str());
+          this->block = this->data_provider->next_block();
+          span.set_arg("lines", this->block->size());
+        }
+        this->block_pos = 0;
+        this->progress.bytes.store(this->bytes_read(),
+                                   std::memory_order_relaxed);
+        if (this->block->empty()) {
+          this->record_status = RecordStatusEof;
+          break;
+        }
+      }
+      auto& lines = this->block->lines;
+      auto& line_numbers = this->block->line_numbers;
+      size_t n = lines.size();
+      size_t i = this->block_pos;
+      bool group_end = false;
+      for (; i < n; i++) {
+        if (lines[i][0] == this->comment) {
+          if (this->contig_keys) {
+            contig_order.add_header_line(lines[i], &this->contig_last,
+                                         this->path);
+          }
+          if (this->vcf) {
+            this->vcf->add_header_line(lines[i], this->path);
+          }
+          this->stats.comments++;
+          continue;
+        }
+        uint32_t cached = this->bcf_contig_keys | this->bcf_position_keys;
+        if (cached != 0) {
+          this->read_bcf_keys(i);
+        }
+        if (!this->row_buffer.add_row(lines[i], line_numbers[i],
+                                      this->bcf_keys, cached)) {
+          group_end = true;
+          i++;
+          break;
+        }
+      }
+      this->stats.lines += i - this->block_pos;
+      this->block_pos = i;
+      if (group_end) {
+        break;
+      }
+    }
+  }
+
+  // the keys of the line n of a BCF block
+  void
+  read_bcf_keys(size_t n) {
+    KeyValue position;
+    position.int_value = this->bcf->line_position(n);
+    KeyValue contig;
+    contig.int_value = 0;
+    if (this->bcf_contig_keys != 0) {
+      contig.int_value = this->bcf_contig_rank(this->bcf->line_contig(n));
+    }
+    for (int i = 0; i < ROW_KEY_CACHE_SIZE; i++) {
+      if (this->bcf_position_keys & (1u << i)) {
+        this->bcf_keys[i] = position;
+      } else if (this->bcf_contig_keys & (1u << i)) {
+        this->bcf_keys[i] = contig;
+      }
+    }
+  }
+
+  // rank in contig_order of a contig of the BCF header
+  int64_t
+  bcf_contig_rank(int32_t contig) {
+    if (contig >= this->bcf_contig_ranks.size()) {
+      this->bcf_contig_ranks.resize(contig + 1, -1);
+    }
+    if (this->bcf_contig_ranks[contig] < 0) {
+      this->bcf_contig_ranks[contig]
+          = contig_order.rank(this->bcf->contig_name(contig));
+    }
+    return this->bcf_contig_ranks[contig];
+  }
+
+  void
+  read_cached_group() {
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    if (!this->cache->next_group(&begin, &end)) {
+      return;
+    }
+    for (auto n = begin; n < end; n++) {
+      this->cache->load_row(n, this->row_buffer.cached_row());
+      this->row_buffer.add_cached_row();
+    }
+    this->stats.lines += end - begin;
+    this->progress.bytes.store(this->bytes_read(), std::memory_order_relaxed);
+  }
+
   uint32_t min_count;
   uint32_t max_count;
   std::string path;
   RowBuffer row_buffer;
   DataProvider* data_provider;
+  CacheDataProvider* cache = nullptr;
+  BcfDataProvider* bcf = nullptr;
+  LineBlock empty_block;
+  LineBlock* block = &empty_block;
+  size_t block_pos = 0;
   int record_limit = -1;
+  // ##contig lines are read into contig_order for contig keys, contig_last
+  // is the rank of the last one
+  bool contig_keys = false;
+  int64_t contig_last = -1;
+  std::unique_ptr<VcfLayout> vcf;
+  // key indexes whose values are read from BCF records
+  uint32_t bcf_contig_keys = 0;
+  uint32_t bcf_position_keys = 0;
+  KeyValue bcf_keys[ROW_KEY_CACHE_SIZE];
+  std::vector<int64_t> bcf_contig_ranks;
 };
 
 } // namespace filterx
@@ -1,15 +1,27 @@
 #pragma once
 
 #include <cassert>
+#include <charconv>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include "contig_order.h"
+#include "symbol_table.h"
+
 namespace filterx {
 
+// number of keys whose parsed value is kept with the row
+static const int ROW_KEY_CACHE_SIZE = 4;
+
+// items from ROW_FIELD_COLUMN on are the fields added by Row::add_field
+static const int ROW_FIELD_COLUMN = 1 << 24;
+
 class Row {
 public:
   Row() = default;
@@ -38,9 +50,12 @@ public:
     }
   }
 
+  // only the first limit columns are split if limit is set, the rest of the
+  // line is not scanned and is dropped from the row
   inline void
-  split() {
-    // [placehoder, start, length, start, length, ...]
+  split(uint32_t limit = 0) {
+    // [nfields, start, length, start, length, ...], the added fields follow
+    // the columns
 
     if (this->splited) {
       return;
@@ -58,6 +73,10 @@ public:
         this->separator_index.push_back(length);
         start = i + 1;
         length = 0;
+        if (limit > 0 && this->separator_index.size() / 2 == limit) {
+          this->row.resize(i);
+          break;
+        }
       } else {
         length++;
       }
@@ -72,6 +91,13 @@ public:
   std::optional<std::string_view>
   get_item(int index) {
     assert(this->splited);
+    if (index >= ROW_FIELD_COLUMN) {
+      uint32_t field = index - ROW_FIELD_COLUMN;
+      if (field >= this->separator_index[0]) {
+        return std::nullopt;
+      }
+      index = this->size() + field;
+    }
     if (index < 0 || index >= this->separator_index.size() / 2) {
       return std::nullopt;
     }
@@ -91,30 +117,144 @@ public:
   void
   clear() {
     this->splited = false;
+    this->cached_keys = 0;
     this->separator_index.clear();
   }
 
   void
   set_separator(char separator) {
     this->splited = false;
+    this->cached_keys = 0;
     this->separator = separator;
   }
 
   void
-  set_row(char* row) {
+  set_row(std::string_view row) {
     this->splited = false;
-    this->row.clear();
-    this->row.append(row);
+    this->cached_keys = 0;
+    this->row.assign(row.data(), row.size());
   }
 
+  // set an already splited row, used by the cache reader
   void
-  set_row(std::string& row) {
-    this->set_row(row.data());
+  set_splited_row(const char* row, size_t length, const uint32_t* index,
+                  size_t nindex) {
+    this->row.assign(row, length);
+    this->separator_index.assign(index, index + nindex);
+    this->splited = true;
+    this->cached_keys = 0;
   }
 
+  // number of columns, the added fields are not counted
   size_t
   size() {
-    return this->separator_index.size() / 2;
+    if (this->separator_index.empty()) {
+      return 0;
+    }
+    return this->separator_index.size() / 2 - this->separator_index[0];
+  }
+
+  // appends a value to a splited row as the item ROW_FIELD_COLUMN + n of
+  // the n-th call. the value is copied after the text, it may point into
+  // the row. an empty value is a missing item
+  void
+  add_field(std::string_view value) {
+    assert(this->splited);
+    this->separator_index[0]++;
+    if (value.empty()) {
+      this->separator_index.push_back(0);
+      this->separator_index.push_back(0);
+      return;
+    }
+    uint32_t start = this->row.size() + 1;
+    const char* text = this->row.data();
+    if (value.data() >= text && value.data() < text + this->row.size()) {
+      size_t offset = value.data() - text;
+      this->row.push_back('\0');
+      this->row.append(this->row, offset, value.size());
+    } else {
+      this->row.push_back('\0');
+      this->row.append(value.data(), value.size());
+    }
+    this->separator_index.push_back(start);
+    this->separator_index.push_back(value.size());
+  }
+
+  // heap memory held by the row
+  size_t
+  memory_size() {
+    return this->row.capacity()
+           + this->separator_index.capacity() * sizeof(uint32_t);
+  }
+
+  // text of a splited row, separators are replaced by '\0'
+  std::string_view
+  splited_text() {
+    assert(this->splited);
+    return this->row;
+  }
+
+  std::vector<uint32_t>&
+  splited_index() {
+    assert(this->splited);
+    return this->separator_index;
+  }
+
+  // binary dump of a splited row: [row_idx, length, bytes, nindex, index]
+  bool
+  write_to(FILE* file) {
+    assert(this->splited);
+    uint32_t length = this->row.size();
+    uint32_t nindex = this->separator_index.size();
+    return fwrite(&this->row_idx, sizeof(uint32_t), 1, file) == 1
+           && fwrite(&length, sizeof(uint32_t), 1, file) == 1
+           && fwrite(this->row.data(), 1, length, file) == length
+           && fwrite(&nindex, sizeof(uint32_t), 1, file) == 1
+           && fwrite(this->separator_index.data(), sizeof(uint32_t), nindex,
+                     file)
+                  == nindex;
+  }
+
+  bool
+  read_from(FILE* file) {
+    uint32_t length = 0;
+    uint32_t nindex = 0;
+    if (fread(&this->row_idx, sizeof(uint32_t), 1, file) != 1
+        || fread(&length, sizeof(uint32_t), 1, file) != 1) {
+      return false;
+    }
+    this->row.resize(length);
+    if (fread(this->row.data(), 1, length, file) != length
+        || fread(&nindex, sizeof(uint32_t), 1, file) != 1) {
+      return false;
+    }
+    this->separator_index.resize(nindex);
+    if (fread(this->separator_index.data(), sizeof(uint32_t), nindex, file)
+        != nindex) {
+      return false;
+    }
+    this->splited = true;
+    this->cached_keys = 0;
+    return true;
+  }
+
+  // parsed values of the first ROW_KEY_CACHE_SIZE keys, so a key is parsed
+  // once per row instead of once per comparison
+  KeyValue*
+  cached_key(int index) {
+    if (index >= ROW_KEY_CACHE_SIZE || !(this->cached_keys & (1 << index))) {
+      return nullptr;
+    }
+    return &this->key_values[index];
+  }
+
+  void
+  set_cached_key(int index, KeyValue value) {
+    if (index >= ROW_KEY_CACHE_SIZE) {
+      return;
+    }
+    this->key_values[index] = value;
+    this->cached_keys |= 1 << index;
   }
 
 public:
@@ -125,6 +265,8 @@ private:
   std::string row;
   std::vector<uint32_t> separator_index;
   bool splited = false;
+  uint32_t cached_keys = 0;
+  KeyValue key_values[ROW_KEY_CACHE_SIZE];
 };
 
 enum RowKeyType {
@@ -132,6 +274,8 @@ enum RowKeyType {
   RowKeyTypeInt = 1 << 1,
   RowKeyTypeString = 1 << 2,
   RowKeyTypeUnknown = 1 << 3,
+  // a contig name ordered by contig_order
+  RowKeyTypeContig = 1 << 4,
 };
 
 enum RowKeySortOrder {
@@ -140,16 +284,61 @@ enum RowKeySortOrder {
   RowKeySortOrderUnknown = 1 << 2,
 };
 
+static inline int64_t
+parse_int_key(std::string_view key) {
+  // check if can convert to int
+  int i = 0;
+  while (i < key.size()) {
+    if (key[i] < '0' || key[i] > '9') {
+      fprintf(stderr, "convert to int error: %s\n", key.data());
+      fprintf(stderr, "Check separator(s) or key type(k)\n");
+      exit(EXIT_FAILURE);
+    }
+    i++;
+  }
+  int64_t value = 0;
+  auto result = std::from_chars(key.data(), key.data() + key.size(), value);
+  if (result.ec != std::errc()) {
+    fprintf(stderr, "convert to int error: %.*s\n", (int)key.size(),
+            key.data());
+    exit(EXIT_FAILURE);
+  }
+  return value;
+}
+
+// strtod needs a terminated string, short keys are copied to the stack
+static inline double
+parse_float_key(std::string_view key) {
+  char buffer[64];
+  std::string long_key;
+  const char* text = buffer;
+  if (key.size() < sizeof(buffer)) {
+    memcpy(buffer, key.data(), key.size());
+    buffer[key.size()] = '\0';
+  } else {
+    long_key.assign(key.data(), key.size());
+    text = long_key.c_str();
+  }
+  char* end = nullptr;
+  double value = strtod(text, &end);
+  if (end == text) {
+    fprintf(stderr, "convert to float error: %s\n", text);
+    fprintf(stderr, "Check separator(s) or key type(k)\n");
+    exit(EXIT_FAILURE);
+  }
+  return value;
+}
+
 class TypedKey {
 public:
   RowKeySortOrder sort_order;
   RowKeyType type;
   std::string_view key;
-  union {
-    int64_t int_value;
-    double float_value;
-  } value;
+  KeyValue value;
   bool cached = false;
+  // row and key index the parsed value is stored back to
+  Row* row = nullptr;
+  int index = 0;
 
   TypedKey() = default;
   TypedKey(RowKeyType type, std::string_view key, RowKeySortOrder sort_order)
@@ -159,6 +348,19 @@ public:
   update_key(std::string_view key) {
     this->key = key;
     this->cached = false;
+    this->row = nullptr;
+  }
+
+  void
+  update_key(std::string_view key, Row* row, int index) {
+    this->key = key;
+    this->row = row;
+    this->index = index;
+    auto value = row->cached_key(index);
+    this->cached = value != nullptr;
+    if (this->cached) {
+      this->value = *value;
+    }
   }
 
   int64_t
@@ -168,18 +370,11 @@ public:
       return this->value.int_value;
     }
     this->cached = true;
-    // check if can convert to int
-    int i = 0;
-    while (i < this->key.size()) {
-      if (this->key[i] < '0' || this->key[i] > '9') {
-        fprintf(stderr, "convert to int error: %s\n", this->key.data());
-        fprintf(stderr, "Check separator(s) or key type(k)\n");
-        exit(EXIT_FAILURE);
-      }
-      i++;
-    }
-    auto v = std::stoll(std::string(this->key));
+    auto v = parse_int_key(this->key);
     this->value.int_value = v;
+    if (this->row != nullptr) {
+      this->row->set_cached_key(this->index, this->value);
+    }
     return v;
   }
 
@@ -190,16 +385,71 @@ public:
       return this->value.float_value;
     }
     this->cached = true;
-    auto v = std::stod(std::string(this->key));
+    auto v = parse_float_key(this->key);
     this->value.float_value = v;
+    if (this->row != nullptr) {
+      this->row->set_cached_key(this->index, this->value);
+    }
     return v;
   }
 
+  // rank of the contig in contig_order
+  int64_t
+  to_contig() {
+    assert(this->type == RowKeyTypeContig);
+    if (this->cached) {
+      return this->value.int_value;
+    }
+    this->cached = true;
+    this->value.int_value = contig_order.rank(this->key);
+    if (this->row != nullptr) {
+      this->row->set_cached_key(this->index, this->value);
+    }
+    return this->value.int_value;
+  }
+
   std::string_view
   to_string() {
     return this->key;
   }
 
+  // symbol of the key in symbol_table, interned on first use
+  KeyValue
+  to_symbol() {
+    assert(this->type == RowKeyTypeString);
+    if (this->cached && symbol_table.valid(this->value)) {
+      return this->value;
+    }
+    this->cached = true;
+    this->value = symbol_table.intern(this->key);
+    if (this->row != nullptr) {
+      this->row->set_cached_key(this->index, this->value);
+    }
+    return this->value;
+  }
+
+  int
+  compare_string(TypedKey* other) {
+    if (!symbol_table.is_enabled()) {
+      return this->key.compare(other->key);
+    }
+    auto a = this->to_symbol();
+    auto b = other->to_symbol();
+    if (!symbol_table.valid(a)) {
+      // the table was dropped while b was interned
+      a = this->to_symbol();
+    }
+    if (a.symbol.id == b.symbol.id) {
+      return 0;
+    }
+    auto pa = symbol_table.prefix(a);
+    auto pb = symbol_table.prefix(b);
+    if (pa != pb) {
+      return pa < pb ? -1 : 1;
+    }
+    return this->key.compare(other->key);
+  }
+
   bool
   equals(TypedKey* other) {
     assert(this->type == other->type);
@@ -211,9 +461,14 @@ public:
     if (this->type == RowKeyTypeFloat) {
       r = this->to_float() == other->to_float();
     }
-    if (this->type == RowKeyTypeString) {
+    if (this->type == RowKeyTypeContig) {
       r = this->to_string() == other->to_string();
     }
+    if (this->type == RowKeyTypeString) {
+      r = symbol_table.is_enabled()
+              ? this->compare_string(other) == 0
+              : this->to_string() == other->to_string();
+    }
     return r;
   }
 
@@ -227,8 +482,11 @@ public:
     if (this->type == RowKeyTypeFloat) {
       r = this->to_float() < other->to_float();
     }
+    if (this->type == RowKeyTypeContig) {
+      r = this->to_contig() < other->to_contig();
+    }
     if (this->type == RowKeyTypeString) {
-      r = this->to_string() < other->to_string();
+      r = this->compare_string(other) < 0;
     }
     return r;
   }
@@ -243,8 +501,11 @@ public:
     if (this->type == RowKeyTypeFloat) {
       r = this->to_float() > other->to_float();
     }
+    if (this->type == RowKeyTypeContig) {
+      r = this->to_contig() > other->to_contig();
+    }
     if (this->type == RowKeyTypeString) {
-      r = this->to_string() > other->to_string();
+      r = this->compare_string(other) > 0;
     }
     return r;
   }
@@ -269,6 +530,11 @@ public:
     this->row = row;
   }
 
+  Row*
+  current_row() {
+    return this->row;
+  }
+
   bool
   equals(RowKey* other) {
     if (this->keys.size() != other->keys.size() || this->keys.empty()) {
@@ -301,7 +567,7 @@ public:
     }
     auto kt = this->key_types[index];
     auto so = this->sort_order[index];
-    this->typed_key.update_key(key.value());
+    this->typed_key.update_key(key.value(), this->row, index);
     this->typed_key.type = kt;
     this->typed_key.sort_order = so;
     return &this->typed_key;
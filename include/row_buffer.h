@@ -1,10 +1,93 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <memory>
 
+#include "aggregate.h"
+#include "memory_governor.h"
 #include "row.h"
+#include "spill.h"
+#include "stats.h"
 
 namespace filterx {
+
+// spill limit used for every group once the memory budget is reached
+static const size_t PRESSURE_SPILL_LIMIT = 1 << 20;
+
+// heap memory of the cleared rows a buffer keeps for reuse
+static const size_t SPARE_ROWS_LIMIT = 1 << 20;
+
+// keep the best [top] rows of a group ranked by a column
+struct RowRank {
+  int top;
+  uint32_t column;
+  RowKeyType type;
+  RowKeySortOrder order;
+};
+
+static inline bool
+rank_value(Row* row, RowRank* rank, double* value, std::string_view* str) {
+  auto item = row->get_item(rank->column);
+  if (!item.has_value()) {
+    return false;
+  }
+  if (rank->type == RowKeyTypeString) {
+    *str = item.value();
+    return true;
+  }
+  // items are followed by '\0' after the row is splited
+  char* end = nullptr;
+  *value = strtod(item.value().data(), &end);
+  return end == item.value().data() + item.value().size();
+}
+
+// true if row a ranks before row b, rows without a valid value rank last and
+// ties keep the file order
+static inline bool
+rank_better(Row* a, Row* b, RowRank* rank) {
+  double va = 0, vb = 0;
+  std::string_view sa, sb;
+  bool ha = rank_value(a, rank, &va, &sa);
+  bool hb = rank_value(b, rank, &vb, &sb);
+  if (ha != hb) {
+    return ha;
+  }
+  if (ha) {
+    int c = 0;
+    if (rank->type == RowKeyTypeString) {
+      c = sa.compare(sb);
+    } else {
+      c = va < vb ? -1 : (va > vb ? 1 : 0);
+    }
+    if (c != 0) {
+      return rank->order == RowKeySortOrderAsc ? c < 0 : c > 0;
+    }
+  }
+  return a->row_idx < b->row_idx;
+}
+
+// tells whether two rows of a file belong to the same group, a kernel
+// specialized for the key columns replaces RowKey::equals when it is set
+class GroupKernel {
+public:
+  virtual ~GroupKernel() = default;
+  virtual bool same_key(Row* a, Row* b) = 0;
+};
+
+// adds fields to every row after it is splited, see Row::add_field
+class FieldExtractor {
+public:
+  virtual ~FieldExtractor() = default;
+  virtual void extract(Row* row) = 0;
+
+  // columns a row is split into before extract, 0 for all of them
+  virtual uint32_t
+  split_limit() {
+    return 0;
+  }
+};
+
 class RowBuffer {
 
 public:
@@ -13,52 +96,198 @@ public:
       : separator(separator), key1(row_keys, key_types, sort_order),
         key2(row_keys, key_types, sort_order) {
     this->rows.reserve(16);
-    this->last_read_row = std::nullopt;
     this->newline = Row();
     this->newline.set_separator(separator);
+    this->last_row.set_separator(separator);
   }
 
+  // keys are the values of the key indexes set in cached when the reader
+  // has them parsed already, they are put into the key cache of the row
   bool
-  add_row(char* line, uint32_t row_idx) {
-    assert(!this->last_read_row.has_value());
+  add_row(std::string_view line, uint32_t row_idx,
+          const KeyValue* keys = nullptr, uint32_t cached = 0) {
+    assert(!this->has_last_row);
 
     this->newline.set_row(line);
     this->newline.row_idx = row_idx;
-    this->newline.split();
-
-    if (this->rows.empty()) {
-      this->rows.push_back(this->newline);
-      this->newline.clear();
-      return true;
+    {
+      StageScope scope(StageSplit);
+      if (this->extractor != nullptr) {
+        this->newline.split(this->extractor->split_limit());
+        this->extractor->extract(&this->newline);
+      } else {
+        this->newline.split();
+      }
+    }
+    for (int i = 0; cached != 0 && i < ROW_KEY_CACHE_SIZE; i++) {
+      if (cached & (1u << i)) {
+        this->newline.set_cached_key(i, keys[i]);
+      }
     }
 
-    this->key1.update_row(&this->rows.back());
-    this->key2.update_row(&this->newline);
-
-    if (!this->key1.equals(&this->key2)) {
-      this->last_read_row = this->newline;
-      this->newline.clear();
-      return false;
+    if (!this->rows.empty()) {
+      bool same = false;
+      if (this->kernel != nullptr) {
+        same = this->kernel->same_key(&this->rows.back(), &this->newline);
+      } else {
+        this->key1.update_row(&this->rows.back());
+        this->key2.update_row(&this->newline);
+        same = this->key1.equals(&this->key2);
+      }
+      if (!same) {
+        // the buffers are swapped, the row of the next group is not copied
+        std::swap(this->last_row, this->newline);
+        this->has_last_row = true;
+        this->newline.clear();
+        this->newline.set_separator(this->separator);
+        return false;
+      }
     }
-    this->rows.push_back(this->newline);
-    this->newline.clear();
+    this->append_newline();
     return true;
   }
 
+  // rows read from a cache file are splited and grouped already: the caller
+  // fills cached_row() and appends it to the current group
+  Row*
+  cached_row() {
+    return &this->newline;
+  }
+
+  void
+  add_cached_row() {
+    assert(!this->has_last_row);
+    this->append_newline();
+  }
+
   void
   consume() {
-    this->rows.clear();
-    if (this->last_read_row.has_value()) {
-      this->rows.push_back(this->last_read_row.value());
-      this->last_read_row.reset();
+    this->recycle_rows(&this->rows);
+    this->rows_bytes = 0;
+    this->count = 0;
+    if (this->spill) {
+      this->spill->reset();
+    }
+    if (this->has_last_row) {
+      this->move_to_rows(&this->last_row);
+      this->has_last_row = false;
+      this->start_aggregate(&this->rows.back());
+      this->rows_bytes = this->rows.back().memory_size();
+      this->count = 1;
+    }
+    this->update_memory();
+  }
+
+  // once the stored rows of a group hold more than limit bytes, the following
+  // rows of the group are written to a spill file, 0 disables spilling
+  void
+  set_spill_limit(size_t limit) {
+    this->spill_limit = limit;
+  }
+
+  // rows more than record_limit are counted but not stored, and once the
+  // group has more rows than max_count only its first row is kept
+  void
+  set_limits(int record_limit, uint32_t max_count) {
+    this->max_count = max_count;
+    this->keep_limit = max_count;
+    if (record_limit >= 0 && record_limit < this->keep_limit) {
+      this->keep_limit = record_limit;
+    }
+    if (this->keep_limit < 1 || this->aggregate) {
+      this->keep_limit = 1;
+    }
+  }
+
+  void
+  set_kernel(GroupKernel* kernel) {
+    this->kernel = kernel;
+  }
+
+  void
+  set_extractor(FieldExtractor* extractor) {
+    this->extractor = extractor;
+  }
+
+  // rows of a group are kept in a heap of rank.top rows while they are read
+  void
+  set_rank(RowRank rank) {
+    this->rank = rank;
+  }
+
+  // called once all rows of the group are read
+  void
+  finish_group() {
+    if (this->ranked() && this->count <= this->max_count) {
+      auto rank = &this->rank;
+      std::sort_heap(
+          this->rows.begin(), this->rows.end(),
+          [rank](Row& a, Row& b) { return rank_better(&a, &b, rank); });
     }
   }
 
+  // statistics of the columns are computed over all rows of a group, only
+  // the first row of a group is stored then
+  void
+  set_aggregate_columns(std::vector<int>& columns) {
+    for (auto column : columns) {
+      if (this->aggregate_column(column) == nullptr) {
+        this->aggregate_columns.emplace_back(column);
+      }
+    }
+    this->aggregate = true;
+    this->keep_limit = 1;
+  }
+
+  AggregateColumn*
+  aggregate_column(int column) {
+    for (auto& c : this->aggregate_columns) {
+      if (c.column == column) {
+        return &c;
+      }
+    }
+    return nullptr;
+  }
+
+  // number of rows of the current group, including rows not stored
   size_t
   size() {
+    return this->count;
+  }
+
+  // number of rows of the current group that are stored in memory or spilled
+  size_t
+  stored() {
+    if (this->spill) {
+      return this->rows.size() + this->spill->size();
+    }
     return this->rows.size();
   }
 
+  // hand the rows of the current group over to the caller, the buffer keeps
+  // the vector and spill file passed in, so no row is copied. the rows left
+  // in out are reused. spilled rows follow the rows in memory and are read
+  // back in order
+  void
+  take_rows(std::vector<Row>* out, std::unique_ptr<SpillFile>* spill) {
+    this->recycle_rows(out);
+    std::swap(*out, this->rows);
+    std::swap(*spill, this->spill);
+    if (*spill) {
+      (*spill)->start_read();
+    }
+    this->rows_bytes = 0;
+    this->update_memory();
+    this->count = 0;
+  }
+
+  // memory held by the stored rows of the current group
+  size_t
+  memory_size() {
+    return this->rows_bytes;
+  }
+
+  // only rows kept in memory can be accessed randomly
   std::optional<Row*>
   get_row(int index) {
     if (index < 0 || index >= this->rows.size()) {
@@ -72,13 +301,164 @@ public:
     if (this->rows.empty()) {
       return std::nullopt;
     }
+    this->key1.update_row(&this->rows.front());
     return &this->key1;
   }
 
 private:
+  void
+  append_newline() {
+    if (this->rows.empty()) {
+      this->move_to_rows(&this->newline);
+      this->start_aggregate(&this->rows.back());
+      this->rows_bytes = this->rows.back().memory_size();
+      this->update_memory();
+      this->count = 1;
+      return;
+    }
+    this->count++;
+    for (auto& column : this->aggregate_columns) {
+      column.add(&this->newline);
+    }
+    if (this->count > this->max_count) {
+      // the group can not pass the max count condition any more, only keep
+      // the first row for the key and go on counting
+      if (this->stored() > 1) {
+        this->rows.erase(this->rows.begin() + 1, this->rows.end());
+        this->rows_bytes = this->rows.front().memory_size();
+        this->update_memory();
+        if (this->spill) {
+          this->spill->reset();
+        }
+      }
+    } else if (this->ranked()) {
+      this->rank_row(&this->newline);
+    } else if (this->stored() < this->keep_limit) {
+      this->store_row(&this->newline);
+    }
+    this->newline.clear();
+  }
+
+  bool
+  ranked() {
+    return this->rank.top > 0 && !this->aggregate;
+  }
+
+  // the heap front is the worst row, it is replaced by a better one once the
+  // heap is full, so a group never holds more than rank.top rows
+  void
+  rank_row(Row* row) {
+    auto rank = &this->rank;
+    auto worse = [rank](Row& a, Row& b) { return rank_better(&a, &b, rank); };
+    if (this->rows.size() < this->rank.top) {
+      this->push_row(row);
+      std::push_heap(this->rows.begin(), this->rows.end(), worse);
+      return;
+    }
+    if (!rank_better(row, &this->rows.front(), rank)) {
+      return;
+    }
+    std::pop_heap(this->rows.begin(), this->rows.end(), worse);
+    this->rows_bytes -= this->rows.back().memory_size();
+    this->rows.back() = *row;
+    this->rows_bytes += this->rows.back().memory_size();
+    this->update_memory();
+    std::push_heap(this->rows.begin(), this->rows.end(), worse);
+  }
+
+  void
+  start_aggregate(Row* row) {
+    for (auto& column : this->aggregate_columns) {
+      column.reset();
+      column.add(row);
+    }
+  }
+
+  void
+  store_row(Row* row) {
+    size_t limit = this->spill_limit;
+    if (memory_governor.over_budget()
+        && (limit == 0 || limit > PRESSURE_SPILL_LIMIT)) {
+      limit = PRESSURE_SPILL_LIMIT;
+    }
+    if (limit > 0 && this->rows_bytes >= limit) {
+      if (!this->spill) {
+        this->spill = std::make_unique<SpillFile>();
+      }
+      this->spill->write(row);
+      return;
+    }
+    this->push_row(row);
+  }
+
+  void
+  push_row(Row* row) {
+    this->move_to_rows(row);
+    this->rows_bytes += this->rows.back().memory_size();
+    this->update_memory();
+  }
+
+  // appends row by swapping buffers, row is left cleared with the buffers of
+  // a spare row if there is one
+  void
+  move_to_rows(Row* row) {
+    this->rows.emplace_back();
+    std::swap(this->rows.back(), *row);
+    if (!this->spare_rows.empty()) {
+      this->spare_bytes -= this->spare_rows.back().memory_size();
+      std::swap(*row, this->spare_rows.back());
+      this->spare_rows.pop_back();
+    }
+    row->clear();
+    row->set_separator(this->separator);
+  }
+
+  // keeps the buffers of cleared rows for the next rows, so a stream of
+  // groups reads without allocating once the buffers are large enough. the
+  // spare rows are freed under memory pressure
+  void
+  recycle_rows(std::vector<Row>* rows) {
+    if (memory_governor.over_budget()) {
+      std::vector<Row>().swap(this->spare_rows);
+      this->spare_bytes = 0;
+    } else {
+      for (auto& row : *rows) {
+        size_t size = row.memory_size();
+        if (this->spare_bytes + size > SPARE_ROWS_LIMIT) {
+          break;
+        }
+        this->spare_bytes += size;
+        this->spare_rows.push_back(std::move(row));
+      }
+    }
+    rows->clear();
+  }
+
+  // stored and spare rows are both held by the buffer
+  void
+  update_memory() {
+    this->memory.update(this->rows_bytes + this->spare_bytes);
+  }
+
   char separator;
+  size_t rows_bytes = 0;
+  size_t spill_limit = 0;
+  std::unique_ptr<SpillFile> spill;
+  GroupKernel* kernel = nullptr;
+  FieldExtractor* extractor = nullptr;
+  MemoryAccount memory{ MemoryRowBuffer };
+  std::vector<AggregateColumn> aggregate_columns;
+  bool aggregate = false;
+  RowRank rank = { -1, 0, RowKeyTypeUnknown, RowKeySortOrderUnknown };
+  size_t count = 0;
+  size_t keep_limit = UINT32_MAX;
+  size_t max_count = UINT32_MAX;
   std::vector<Row> rows;
-  std::optional<Row> last_read_row;
+  std::vector<Row> spare_rows;
+  size_t spare_bytes = 0;
+  // the first row of the next group, read to find the end of the current one
+  Row last_row;
+  bool has_last_row = false;
   Row newline;
   RowKey key1;
   RowKey key2;
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "row.h"
+
+namespace filterx {
+
+// rows of an oversized key group that are moved out of memory, they are
+// written once and then read back in order
+class SpillFile {
+public:
+  ~SpillFile() {
+    if (this->file != nullptr) {
+      fclose(this->file);
+    }
+  }
+
+  void
+  write(Row* row) {
+    if (this->file == nullptr) {
+      this->file = tmpfile();
+      if (this->file == nullptr) {
+        fprintf(stderr, "Failed to create spill file, message: %s\n"
+                        "Try to set a bigger --spill-size or 0 to disable "
+                        "spilling\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+      }
+    }
+    if (this->reading) {
+      this->reset();
+    }
+    if (!row->write_to(this->file)) {
+      fprintf(stderr, "Failed to write spill file, message: %s\n",
+              strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    this->count++;
+  }
+
+  // drop all rows, the file is reused by the next group
+  void
+  reset() {
+    this->count = 0;
+    this->nread = 0;
+    this->reading = false;
+    if (this->file != nullptr) {
+      fseek(this->file, 0, SEEK_SET);
+    }
+  }
+
+  void
+  start_read() {
+    this->reading = true;
+    this->nread = 0;
+    if (this->file != nullptr) {
+      fflush(this->file);
+      fseek(this->file, 0, SEEK_SET);
+    }
+  }
+
+  bool
+  read(Row* row) {
+    assert(this->reading);
+    if (this->nread >= this->count) {
+      return false;
+    }
+    if (!row->read_from(this->file)) {
+      fprintf(stderr, "Failed to read spill file\n");
+      exit(EXIT_FAILURE);
+    }
+    this->nread++;
+    return true;
+  }
+
+  size_t
+  size() {
+    return this->count;
+  }
+
+private:
+  FILE* file = nullptr;
+  size_t count = 0;
+  size_t nread = 0;
+  bool reading = false;
+};
+
+} // namespace filterx
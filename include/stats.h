@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "alloc_stats.h"
+#include "perf_counters.h"
+
+namespace filterx {
+
+enum StatsFormat {
+  StatsFormatNone = 0,
+  StatsFormatText = 1,
+  StatsFormatJson = 2,
+};
+
+// parts of the work of filterx. a thread is in one stage at a time, the
+// time of a stage started inside another one is not counted in the outer one
+enum Stage {
+  StageRead = 0,
+  StageDecompress = 1,
+  StageSplit = 2,
+  StageGroup = 3,
+  StageMerge = 4,
+  StageFormat = 5,
+  StageWrite = 6,
+  StageCount = 7,
+};
+
+static const int StageNone = -1;
+
+// counters of one input, updated by the merge thread
+struct FileStats {
+  uint64_t lines = 0;
+  uint64_t comments = 0;
+  uint64_t groups = 0;
+  // groups dropped by m/M, by req and for missing key columns
+  uint64_t dropped_count = 0;
+  uint64_t dropped_exist = 0;
+  uint64_t dropped_key = 0;
+};
+
+struct FileStatsEntry {
+  std::string path;
+  uint64_t bytes;
+  FileStats* stats;
+};
+
+// a cheap clock, the time stamp counter where there is one. ticks are turned
+// into seconds with the steady clock at the end
+static inline uint64_t
+stats_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+// stage times of one thread. reading the cpu time of a thread costs a
+// system call on some platforms, so it is read at most every
+// STATS_CPU_SAMPLE_TICKS and split over the stages run since then by their
+// wall time. hardware counters are read at every switch when rdpmc can be
+// used, and sampled with the cpu time otherwise
+class StageClock {
+public:
+  int
+  switch_to(int stage) {
+    uint64_t now = stats_ticks();
+    int previous = this->stage;
+    if (previous != StageNone) {
+      uint64_t elapsed = now - this->since;
+      this->wall[previous] += elapsed;
+      this->pending[previous] += elapsed;
+    }
+    if (this->exact_counters) {
+      this->count_events(previous);
+    }
+    this->since = now;
+    this->stage = stage;
+#ifdef FILTERX_ALLOC_STATS
+    alloc_stage_counts = stage == StageNone ? nullptr : &this->allocs[stage];
+#endif
+    if (stage == StageNone || now - this->sampled >= STATS_CPU_SAMPLE_TICKS) {
+      this->sample_cpu(now);
+    }
+    return previous;
+  }
+
+  void sample_cpu(uint64_t now);
+
+  uint64_t wall[StageCount] = {};
+  double cpu[StageCount] = {};
+  // hardware counters of the thread with --counters
+  PerfCounters* counters = nullptr;
+  bool exact_counters = false;
+  uint64_t events[StageCount][CounterCount] = {};
+  // heap allocations of every stage in FILTERX_ALLOC_STATS builds
+  AllocCounts allocs[StageCount];
+
+private:
+  static const uint64_t STATS_CPU_SAMPLE_TICKS = 200000;
+
+  void count_events(int previous);
+
+  uint64_t last_events[CounterCount] = {};
+  uint64_t pending[StageCount] = {};
+  int stage = StageNone;
+  uint64_t since = 0;
+  uint64_t sampled = 0;
+  double cpu_seconds = -1;
+};
+
+class Stats {
+public:
+  // counters: also count cycles, instructions, branch and cache misses of
+  // every stage
+  void enable(StatsFormat format, bool counters = false);
+
+  bool
+  on() {
+    return this->format != StatsFormatNone;
+  }
+
+  // the clock of the calling thread
+  StageClock* thread_clock();
+
+  void
+  add_output(uint64_t bytes) {
+    this->output_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  void report(FILE* file, std::vector<FileStatsEntry>& files);
+
+  uint64_t output_groups = 0;
+  // merged groups dropped by -cnt, -freq and req
+  uint64_t dropped_groups = 0;
+
+private:
+  void report_text(FILE* file, std::vector<FileStatsEntry>& files,
+                   double wall, double user, double sys, double tick_seconds);
+  void report_json(FILE* file, std::vector<FileStatsEntry>& files,
+                   double wall, double user, double sys, double tick_seconds);
+  void report_counters_text(FILE* file);
+  void report_counters_json(FILE* file);
+  void report_allocs_text(FILE* file);
+  void report_allocs_json(FILE* file);
+  PerfCounters* open_counters();
+
+  StatsFormat format = StatsFormatNone;
+  bool counters = false;
+  // why the counters could not be opened, empty if they were
+  std::string counters_error;
+  // the counters the cpu has, from the first thread that opened them
+  bool has_counter[CounterCount] = {};
+  bool counters_opened = false;
+  // some thread could not use rdpmc
+  bool counters_sampled = false;
+  std::atomic<uint64_t> output_bytes{ 0 };
+  uint64_t start_ticks = 0;
+  std::chrono::steady_clock::time_point start_time;
+  std::mutex mutex;
+  std::vector<StageClock*> clocks;
+};
+
+extern Stats stats;
+
+// s quoted and escaped as a json string
+void write_json_string(FILE* file, const std::string& s);
+
+// counts the time of its scope to a stage, nothing is done without --stats
+class StageScope {
+public:
+  StageScope(int stage) {
+    if (stats.on()) {
+      this->clock = stats.thread_clock();
+      this->previous = this->clock->switch_to(stage);
+    }
+  }
+
+  ~StageScope() {
+    if (this->clock != nullptr) {
+      this->clock->switch_to(this->previous);
+    }
+  }
+
+  StageScope(const StageScope&) = delete;
+  StageScope& operator=(const StageScope&) = delete;
+
+private:
+  StageClock* clock = nullptr;
+  int previous = StageNone;
+};
+
+} // namespace filterx
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "memory_governor.h"
+
+namespace filterx {
+
+// parsed value of a numeric key, or the symbol of an interned string key
+union KeyValue {
+  int64_t int_value;
+  double float_value;
+  struct {
+    uint32_t id;
+    uint32_t generation;
+  } symbol;
+};
+
+// string keys interned into a table shared by all files, equal keys get the
+// same id, so equality is an integer compare. every symbol keeps the first 8
+// bytes of its key as a big-endian word, ordering compares the words and only
+// compares the text of keys sharing the same first 8 bytes.
+// input is merged in key order, so old keys are not needed again: once the
+// table is full it is dropped and a new generation starts, ids of older
+// generations are interned again when they are used
+static const size_t SYMBOL_TABLE_LIMIT = 1 << 20;
+// the table is dropped earlier once the memory budget is reached
+static const size_t SYMBOL_PRESSURE_LIMIT = 4096;
+static const size_t SYMBOL_CHUNK_SIZE = 1 << 20;
+
+class SymbolTable {
+public:
+  void
+  set_enabled(bool enabled) {
+    this->enabled = enabled;
+  }
+
+  bool
+  is_enabled() {
+    return this->enabled;
+  }
+
+  bool
+  valid(KeyValue value) {
+    return value.symbol.generation == this->generation;
+  }
+
+  uint64_t
+  prefix(KeyValue value) {
+    return this->prefixes[value.symbol.id - 1];
+  }
+
+  KeyValue intern(std::string_view key);
+
+private:
+  // open addressing slot, id 0 marks an empty slot
+  struct Slot {
+    uint64_t hash;
+    uint32_t id;
+  };
+
+  void reset();
+  void grow();
+  std::string_view store(std::string_view key);
+
+  bool enabled = false;
+  uint32_t generation = 1;
+  std::vector<Slot> slots;
+  // keys and prefix words by id - 1
+  std::vector<std::string_view> keys;
+  std::vector<uint64_t> prefixes;
+  std::vector<std::unique_ptr<char[]> > chunks;
+  size_t chunk_used = SYMBOL_CHUNK_SIZE;
+  size_t text_size = 0;
+  MemoryAccount memory{ MemorySymbolTable };
+};
+
+extern SymbolTable symbol_table;
+
+} // namespace filterx
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "stats.h"
+
+namespace filterx {
+
+// a span of time on one thread. names and details are not copied, they must
+// live until the trace is written
+struct TraceEvent {
+  const char* name;
+  const char* category;
+  // a file name or nullptr
+  const char* detail;
+  // a count shown as arg_name, e.g. the bytes of a write
+  const char* arg_name;
+  int64_t arg;
+  uint64_t begin;
+  uint64_t end;
+};
+
+// events of one thread. only the thread appends, the chunks are never moved,
+// so the trace can be written while a thread still runs
+class ThreadTrace {
+public:
+  static const size_t CHUNK_EVENTS = 4096;
+  // events kept per thread, later ones are counted as dropped
+  static const size_t MAX_EVENTS = 4 << 20;
+
+  struct Chunk {
+    TraceEvent events[CHUNK_EVENTS];
+    std::atomic<size_t> size{ 0 };
+    std::atomic<Chunk*> next{ nullptr };
+  };
+
+  ThreadTrace(int tid) : tid(tid) {}
+  ~ThreadTrace();
+
+  void
+  add(const TraceEvent& event) {
+    if (this->last == nullptr
+        || this->last->size.load(std::memory_order_relaxed) == CHUNK_EVENTS) {
+      if (!this->grow()) {
+        this->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+    size_t n = this->last->size.load(std::memory_order_relaxed);
+    this->last->events[n] = event;
+    this->last->size.store(n + 1, std::memory_order_release);
+  }
+
+  int tid;
+  std::atomic<const char*> name{ "thread" };
+  std::atomic<Chunk*> first{ nullptr };
+  std::atomic<uint64_t> dropped{ 0 };
+
+private:
+  bool grow();
+
+  Chunk* last = nullptr;
+  size_t nchunks = 0;
+};
+
+// --trace <file>: spans of the stages of every thread, written as Chrome
+// trace events at exit, for chrome://tracing or ui.perfetto.dev
+class Tracer {
+public:
+  ~Tracer();
+
+  void enable(const std::string& path);
+
+  bool
+  on() {
+    return this->enabled.load(std::memory_order_relaxed);
+  }
+
+  // names the calling thread in the trace
+  void name_thread(const char* name);
+  ThreadTrace* thread_trace();
+
+  void
+  add(const char* name, const char* category, uint64_t begin,
+      const char* detail = nullptr, const char* arg_name = nullptr,
+      int64_t arg = 0) {
+    this->thread_trace()->add(
+        { name, category, detail, arg_name, arg, begin, stats_ticks() });
+  }
+
+  void write();
+
+private:
+  std::atomic<bool> enabled{ false };
+  FILE* file = nullptr;
+  std::string path;
+  uint64_t start_ticks = 0;
+  std::chrono::steady_clock::time_point start_time;
+  std::mutex mutex;
+  std::vector<ThreadTrace*> threads;
+};
+
+extern Tracer tracer;
+
+// a span from its construction to the end of its scope, nothing is done
+// without --trace
+class TraceSpan {
+public:
+  TraceSpan(const char* name, const char* category,
+            const char* detail = nullptr) {
+    if (tracer.on()) {
+      this->name = name;
+      this->category = category;
+      this->detail = detail;
+      this->begin = stats_ticks();
+    }
+  }
+
+  ~TraceSpan() {
+    if (this->name != nullptr) {
+      tracer.add(this->name, this->category, this->begin, this->detail,
+                 this->arg_name, this->arg);
+    }
+  }
+
+  // a count shown with the span
+  void
+  set_arg(const char* arg_name, int64_t arg) {
+    this->arg_name = arg_name;
+    this->arg = arg;
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+  const char* name = nullptr;
+  const char* category = nullptr;
+  const char* detail = nullptr;
+  const char* arg_name = nullptr;
+  int64_t arg = 0;
+  uint64_t begin = 0;
+};
+
+} // namespace filterx
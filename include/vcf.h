@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "row.h"
+#include "row_buffer.h"
+
+namespace filterx {
+
+// columns of a VCF row
+static const int VCF_INFO_COLUMN = 7;
+static const int VCF_FORMAT_COLUMN = 8;
+static const int VCF_SAMPLE_COLUMN = 9;
+
+enum VcfFieldKind {
+  VcfFieldInfo = 0,
+  VcfFieldFormat = 1,
+};
+
+// INFO/<key>, or FORMAT/<key>@<sample>
+struct VcfField {
+  VcfFieldKind kind;
+  std::string key;
+  std::string sample;
+};
+
+// the VCF fields named by k= and cut= of all files, field n is the column
+// ROW_FIELD_COLUMN + n of a row
+class VcfFields {
+public:
+  // column of a name: CHROM to FORMAT are the fixed columns, INFO/<key> and
+  // FORMAT/<key>@<sample> are fields. -1 and error if the name is invalid
+  int column(std::string_view name, std::string* error);
+
+  size_t
+  size() {
+    return this->fields.size();
+  }
+
+  VcfField&
+  get(size_t n) {
+    return this->fields[n];
+  }
+
+private:
+  std::vector<VcfField> fields;
+};
+
+extern VcfFields vcf_fields;
+
+// adds the VCF fields used by one file to its rows. an INFO value is searched
+// in the INFO column and a FORMAT value in the column of its sample only.
+// rows are split up to the last column used, so the samples after it are
+// not scanned. fields used by other files are left empty
+class VcfLayout : public FieldExtractor {
+public:
+  VcfLayout(std::vector<uint32_t>& keys, std::vector<int>& columns);
+
+  // the column, or field, is read from the rows
+  void use(int column);
+  void use_all_columns();
+
+  // no field is used by the file
+  bool
+  empty() {
+    return this->used.empty();
+  }
+
+  // finds the sample columns in the #CHROM line
+  void add_header_line(std::string_view line, const std::string& path);
+
+  void extract(Row* row) override;
+
+  uint32_t
+  split_limit() override {
+    return this->limit;
+  }
+
+private:
+  void update_limit();
+
+  std::vector<bool> used;
+  // column of the sample of every FORMAT field, known after the #CHROM line
+  std::vector<int> sample_columns;
+  bool has_format = false;
+  bool has_header = false;
+  // last plain column used, rows are split into limit columns
+  int last_column = -1;
+  bool all_columns = false;
+  uint32_t limit = 0;
+};
+
+} // namespace filterx
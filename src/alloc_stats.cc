@@ -0,0 +1,106 @@
+#include "alloc_stats.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace filterx {
+
+#ifdef FILTERX_ALLOC_STATS
+
+thread_local AllocCounts* alloc_stage_counts = nullptr;
+
+static std::atomic<uint64_t> total_calls{ 0 };
+static std::atomic<uint64_t> total_bytes{ 0 };
+
+AllocCounts
+alloc_total() {
+  AllocCounts counts;
+  counts.calls = total_calls.load(std::memory_order_relaxed);
+  counts.bytes = total_bytes.load(std::memory_order_relaxed);
+  return counts;
+}
+
+static void*
+counted_alloc(size_t size) {
+  total_calls.fetch_add(1, std::memory_order_relaxed);
+  total_bytes.fetch_add(size, std::memory_order_relaxed);
+  auto counts = alloc_stage_counts;
+  if (counts != nullptr) {
+    counts->calls++;
+    counts->bytes += size;
+  }
+  return malloc(size > 0 ? size : 1);
+}
+
+#else
+
+AllocCounts
+alloc_total() {
+  return AllocCounts();
+}
+
+#endif
+
+} // namespace filterx
+
+#ifdef FILTERX_ALLOC_STATS
+
+// over-aligned allocations keep the library versions, nothing in filterx
+// asks for them
+
+void*
+operator new(size_t size) {
+  void* p = filterx::counted_alloc(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void*
+operator new[](size_t size) {
+  return operator new(size);
+}
+
+void*
+operator new(size_t size, const std::nothrow_t&) noexcept {
+  return filterx::counted_alloc(size);
+}
+
+void*
+operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return filterx::counted_alloc(size);
+}
+
+void
+operator delete(void* p) noexcept {
+  free(p);
+}
+
+void
+operator delete[](void* p) noexcept {
+  free(p);
+}
+
+void
+operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+void
+operator delete[](void* p, size_t) noexcept {
+  free(p);
+}
+
+void
+operator delete(void* p, const std::nothrow_t&) noexcept {
+  free(p);
+}
+
+void
+operator delete[](void* p, const std::nothrow_t&) noexcept {
+  free(p);
+}
+
+#endif
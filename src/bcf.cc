@@ -0,0 +1,791 @@
+#include "bcf.h"
+
+#include <algorithm>
+#include <charconv>
+
+#include "vcf.h"
+
+namespace filterx {
+
+static const char BCF_MAGIC[] = { 'B', 'C', 'F', 2 };
+
+// text of records written at once, and input read at once
+static const size_t BCF_BLOCK_SIZE = 128 << 10;
+static const size_t BCF_READ_SIZE = 128 << 10;
+
+enum BcfType {
+  BcfTypeNull = 0,
+  BcfTypeInt8 = 1,
+  BcfTypeInt16 = 2,
+  BcfTypeInt32 = 3,
+  BcfTypeFloat = 5,
+  BcfTypeChar = 7,
+};
+
+// missing and end of vector values of floats
+static const uint32_t BCF_FLOAT_MISSING = 0x7f800001;
+static const uint32_t BCF_FLOAT_END = 0x7f800002;
+
+bool
+is_bcf_file(const char* head, size_t size) {
+  if (size >= sizeof(BCF_MAGIC)
+      && memcmp(head, BCF_MAGIC, sizeof(BCF_MAGIC)) == 0) {
+    return true;
+  }
+  if (size < 2 || static_cast<unsigned char>(head[0]) != 0x1f
+      || static_cast<unsigned char>(head[1]) != 0x8b) {
+    return false;
+  }
+  // the magic is at the start of the first gzip member
+  char magic[sizeof(BCF_MAGIC)];
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+    return false;
+  }
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(head));
+  stream.avail_in = size;
+  stream.next_out = reinterpret_cast<Bytef*>(magic);
+  stream.avail_out = sizeof(magic);
+  int ret = inflate(&stream, Z_NO_FLUSH);
+  bool bcf = (ret == Z_OK || ret == Z_STREAM_END) && stream.avail_out == 0
+             && memcmp(magic, BCF_MAGIC, sizeof(BCF_MAGIC)) == 0;
+  inflateEnd(&stream);
+  return bcf;
+}
+
+// BCF is little endian
+static inline uint32_t
+le32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline int
+type_size(int type) {
+  switch (type) {
+  case BcfTypeNull:
+    return 0;
+  case BcfTypeInt8:
+  case BcfTypeChar:
+    return 1;
+  case BcfTypeInt16:
+    return 2;
+  case BcfTypeInt32:
+  case BcfTypeFloat:
+    return 4;
+  }
+  return -1;
+}
+
+// value i of an int vector, missing and end are set for the reserved values
+static inline int64_t
+int_at(const uint8_t* data, int type, size_t i, bool* missing, bool* end) {
+  int64_t v = 0;
+  int64_t min = 0;
+  switch (type) {
+  case BcfTypeInt8:
+    v = static_cast<int8_t>(data[i]);
+    min = INT8_MIN;
+    break;
+  case BcfTypeInt16:
+    v = static_cast<int16_t>(data[i * 2] | (data[i * 2 + 1] << 8));
+    min = INT16_MIN;
+    break;
+  default:
+    v = static_cast<int32_t>(le32(data + i * 4));
+    min = INT32_MIN;
+  }
+  *missing = v == min;
+  *end = v == min + 1;
+  return v;
+}
+
+// values are written to a buffer reserved for their largest text
+static const size_t BCF_INT_TEXT = 12;
+static const size_t BCF_FLOAT_TEXT = 16;
+
+static inline char*
+write_int(char* out, int64_t value) {
+  return std::to_chars(out, out + 20, value).ptr;
+}
+
+static inline char*
+write_float(char* out, uint32_t bits) {
+  if (bits == BCF_FLOAT_MISSING) {
+    *out++ = '.';
+    return out;
+  }
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  // whole numbers, like most QUAL values, are printed as ints
+  if (value > -1e9f && value < 1e9f && value == (int32_t)value) {
+    return write_int(out, (int32_t)value);
+  }
+  return out + snprintf(out, BCF_FLOAT_TEXT, "%g", value);
+}
+
+// largest text of count values of a typed value
+static inline size_t
+text_bound(int type, uint32_t count) {
+  if (type == BcfTypeChar) {
+    return count + 1;
+  }
+  return (size_t)count * (type == BcfTypeFloat ? BCF_FLOAT_TEXT : BCF_INT_TEXT)
+         + 1;
+}
+
+static char*
+write_values(char* out, int type, const uint8_t* data, size_t first,
+             uint32_t count) {
+  if (type == BcfTypeChar) {
+    auto s = reinterpret_cast<const char*>(data) + first;
+    size_t n = strnlen(s, count);
+    if (n == 0) {
+      *out++ = '.';
+      return out;
+    }
+    memcpy(out, s, n);
+    return out + n;
+  }
+  char* start = out;
+  for (uint32_t i = 0; i < count; i++) {
+    if (type == BcfTypeFloat) {
+      uint32_t bits = le32(data + (first + i) * 4);
+      if (bits == BCF_FLOAT_END) {
+        break;
+      }
+      if (out != start) {
+        *out++ = ',';
+      }
+      out = write_float(out, bits);
+      continue;
+    }
+    bool missing, end;
+    int64_t v = int_at(data, type, first + i, &missing, &end);
+    if (end) {
+      break;
+    }
+    if (out != start) {
+      *out++ = ',';
+    }
+    if (missing) {
+      *out++ = '.';
+    } else {
+      out = write_int(out, v);
+    }
+  }
+  if (out == start) {
+    *out++ = '.';
+  }
+  return out;
+}
+
+// alleles are stored as (allele + 1) << 1 | phased
+static char*
+write_genotype(char* out, int type, const uint8_t* data, size_t first,
+               uint32_t count) {
+  char* start = out;
+  for (uint32_t i = 0; i < count; i++) {
+    bool missing, end;
+    int64_t v = int_at(data, type, first + i, &missing, &end);
+    if (end) {
+      break;
+    }
+    if (out != start) {
+      *out++ = (v & 1) ? '|' : '/';
+    }
+    int64_t allele = (v >> 1) - 1;
+    if (missing || allele < 0) {
+      *out++ = '.';
+    } else if (allele < 10) {
+      *out++ = '0' + allele;
+    } else {
+      out = write_int(out, allele);
+    }
+  }
+  if (out == start) {
+    *out++ = '.';
+  }
+  return out;
+}
+
+// value of key in a <key=value,...> header line, quoted values may hold
+// commas
+static std::string_view
+header_attribute(std::string_view line, std::string_view key) {
+  auto pos = line.find('<');
+  if (pos == std::string_view::npos) {
+    return std::string_view();
+  }
+  pos++;
+  while (pos < line.size()) {
+    auto eq = line.find('=', pos);
+    if (eq == std::string_view::npos) {
+      break;
+    }
+    auto end = eq + 1;
+    bool quoted = false;
+    while (end < line.size()) {
+      char c = line[end];
+      if (quoted && c == '\\') {
+        end += 2;
+        continue;
+      }
+      if (c == '"') {
+        quoted = !quoted;
+      } else if (!quoted && (c == ',' || c == '>')) {
+        break;
+      }
+      end++;
+    }
+    if (line.substr(pos, eq - pos) == key) {
+      return line.substr(eq + 1, std::min(end, line.size()) - eq - 1);
+    }
+    pos = end + 1;
+  }
+  return std::string_view();
+}
+
+BcfDataProvider::~BcfDataProvider() { this->close(); }
+
+bool
+BcfDataProvider::open(const std::string& path) {
+  auto source = open_file_source(path);
+  if (source == nullptr) {
+    return false;
+  }
+  this->attach(source);
+  return true;
+}
+
+void
+BcfDataProvider::attach(FileSource* source) {
+  this->path = source->path;
+  auto head = source->head();
+  if (head.size() >= 2 && static_cast<unsigned char>(head[0]) == 0x1f
+      && static_cast<unsigned char>(head[1]) == 0x8b) {
+    auto gzip = new GzipDataProvider();
+    gzip->attach(source);
+    this->raw = gzip;
+  } else {
+    auto plain = new PlainDataProvider();
+    plain->attach(source);
+    this->raw = plain;
+  }
+}
+
+void
+BcfDataProvider::close() {
+  delete this->raw;
+  this->raw = nullptr;
+  std::string().swap(this->input);
+  std::string().swap(this->text);
+  this->memory.update(0);
+}
+
+void
+BcfDataProvider::use_column(int column) {
+  if (!this->keep_all) {
+    this->all_columns = false;
+  }
+  if (column >= ROW_FIELD_COLUMN) {
+    auto& field = vcf_fields.get(column - ROW_FIELD_COLUMN);
+    if (field.kind == VcfFieldInfo) {
+      column = VCF_INFO_COLUMN;
+    } else {
+      column = VCF_FORMAT_COLUMN;
+      this->sample_names.push_back(field.sample);
+    }
+  }
+  if (column < 0) {
+    return;
+  }
+  if (this->columns.size() <= column) {
+    this->columns.resize(column + 1, false);
+  }
+  this->columns[column] = true;
+}
+
+void
+BcfDataProvider::use_all_columns() {
+  this->all_columns = true;
+  this->keep_all = true;
+}
+
+void
+BcfDataProvider::corrupt() {
+  fprintf(stderr, "%s is not a valid BCF file\n", this->path.c_str());
+  exit(EXIT_FAILURE);
+}
+
+bool
+BcfDataProvider::fill(size_t size) {
+  while (this->input.size() - this->input_pos < size) {
+    if (this->input_eof) {
+      return false;
+    }
+    if (this->input_pos > 0) {
+      this->input.erase(0, this->input_pos);
+      this->input_pos = 0;
+    }
+    size_t used = this->input.size();
+    size_t n = std::max(BCF_READ_SIZE, size - used);
+    this->input.resize(used + n);
+    size_t got = this->raw->read_raw(&this->input[used], n);
+    this->input.resize(used + got);
+    this->input_eof = got == 0;
+    this->memory.update(this->input.capacity() + this->text.capacity());
+  }
+  return true;
+}
+
+void
+BcfDataProvider::read_header() {
+  this->header_read = true;
+  this->strings.push_back("PASS");
+  this->string_ids["PASS"] = 0;
+  // magic, major and minor version and the size of the header text
+  if (!this->fill(sizeof(BCF_MAGIC) + 1 + 4)) {
+    this->corrupt();
+  }
+  auto p = reinterpret_cast<const uint8_t*>(this->input.data());
+  if (memcmp(p, BCF_MAGIC, sizeof(BCF_MAGIC)) != 0) {
+    this->corrupt();
+  }
+  uint32_t size = le32(p + sizeof(BCF_MAGIC) + 1);
+  this->input_pos += sizeof(BCF_MAGIC) + 1 + 4;
+  if (!this->fill(size)) {
+    this->corrupt();
+  }
+  this->header.assign(this->input.data() + this->input_pos, size);
+  this->input_pos += size;
+  while (!this->header.empty()
+         && (this->header.back() == '\0' || this->header.back() == '\n')) {
+    this->header.pop_back();
+  }
+  std::string_view text(this->header);
+  size_t pos = 0;
+  while (pos < text.size()) {
+    auto end = text.find('\n', pos);
+    if (end == std::string_view::npos) {
+      end = text.size();
+    }
+    this->add_header_line(text.substr(pos, end - pos));
+    pos = end + 1;
+  }
+  auto genotype = this->string_ids.find("GT");
+  if (genotype != this->string_ids.end()) {
+    this->genotype_key = genotype->second;
+  }
+  for (auto& name : this->sample_names) {
+    auto it = std::find(this->samples.begin(), this->samples.end(), name);
+    if (it != this->samples.end()) {
+      this->use_column(VCF_SAMPLE_COLUMN + (it - this->samples.begin()));
+    }
+  }
+}
+
+void
+BcfDataProvider::add_header_line(std::string_view line) {
+  if (line.substr(0, 6) == "#CHROM") {
+    size_t pos = 0;
+    int column = 0;
+    while (pos <= line.size()) {
+      auto end = line.find('\t', pos);
+      if (end == std::string_view::npos) {
+        end = line.size();
+      }
+      if (column >= VCF_SAMPLE_COLUMN) {
+        this->samples.emplace_back(line.substr(pos, end - pos));
+      }
+      column++;
+      pos = end + 1;
+    }
+    return;
+  }
+  bool contig = line.substr(0, 10) == "##contig=<";
+  bool info = line.substr(0, 8) == "##INFO=<";
+  if (!contig && !info && line.substr(0, 10) != "##FILTER=<"
+      && line.substr(0, 10) != "##FORMAT=<") {
+    return;
+  }
+  std::string id(header_attribute(line, "ID"));
+  if (id.empty()) {
+    return;
+  }
+  // ids are numbered in the order of the header unless IDX is given
+  auto idx_text = header_attribute(line, "IDX");
+  int idx = -1;
+  if (!idx_text.empty()) {
+    std::from_chars(idx_text.data(), idx_text.data() + idx_text.size(), idx);
+  }
+  if (contig) {
+    if (idx < 0) {
+      idx = this->contigs.size();
+    }
+    if (this->contigs.size() <= idx) {
+      this->contigs.resize(idx + 1);
+    }
+    this->contigs[idx] = id;
+    return;
+  }
+  auto it = this->string_ids.find(id);
+  if (it != this->string_ids.end()) {
+    idx = it->second;
+  } else {
+    if (idx < 0) {
+      idx = this->strings.size();
+    }
+    if (this->strings.size() <= idx) {
+      this->strings.resize(idx + 1);
+    }
+    this->strings[idx] = id;
+    this->string_ids[id] = idx;
+  }
+  if (info && header_attribute(line, "Type") == "Flag") {
+    if (this->info_flags.size() <= idx) {
+      this->info_flags.resize(idx + 1, false);
+    }
+    this->info_flags[idx] = true;
+  }
+}
+
+void
+BcfDataProvider::read_typed(const uint8_t** p, const uint8_t* end,
+                            Typed* typed) {
+  if (*p >= end) {
+    this->corrupt();
+  }
+  uint8_t descriptor = *(*p)++;
+  typed->type = descriptor & 0xf;
+  typed->count = descriptor >> 4;
+  if (typed->count == 15) {
+    typed->count = this->read_typed_int(p, end);
+  }
+  if (type_size(typed->type) < 0) {
+    this->corrupt();
+  }
+  typed->data = *p;
+}
+
+int64_t
+BcfDataProvider::read_typed_int(const uint8_t** p, const uint8_t* end) {
+  if (*p >= end) {
+    this->corrupt();
+  }
+  int type = **p & 0xf;
+  (*p)++;
+  int size = type_size(type);
+  if (size <= 0 || type == BcfTypeFloat || type == BcfTypeChar
+      || *p + size > end) {
+    this->corrupt();
+  }
+  bool missing, last;
+  int64_t value = int_at(*p, type, 0, &missing, &last);
+  *p += size;
+  return value;
+}
+
+char*
+BcfDataProvider::reserve_text(size_t size) {
+  size_t used = this->text.size();
+  this->text.resize(used + size);
+  return &this->text[used];
+}
+
+void
+BcfDataProvider::commit_text(char* end) {
+  this->text.resize(end - this->text.data());
+}
+
+void
+BcfDataProvider::append_values(Typed& typed) {
+  char* out = this->reserve_text(text_bound(typed.type, typed.count));
+  this->commit_text(write_values(out, typed.type, typed.data, 0, typed.count));
+}
+
+void
+BcfDataProvider::append_record(const uint8_t* shared, uint32_t l_shared,
+                               const uint8_t* indiv, uint32_t l_indiv) {
+  if (l_shared < 24) {
+    this->corrupt();
+  }
+  const uint8_t* end = shared + l_shared;
+  int32_t chrom = le32(shared);
+  int32_t pos = le32(shared + 4);
+  uint32_t qual = le32(shared + 12);
+  uint32_t n_allele_info = le32(shared + 16);
+  uint32_t n_fmt_sample = le32(shared + 20);
+  uint32_t n_info = n_allele_info & 0xffff;
+  uint32_t n_allele = n_allele_info >> 16;
+  uint32_t n_sample = n_fmt_sample & 0xffffff;
+  uint32_t n_fmt = n_fmt_sample >> 24;
+  if (chrom < 0 || chrom >= this->contigs.size()) {
+    this->corrupt();
+  }
+  this->line_contigs.push_back(chrom);
+  this->line_positions.push_back((int64_t)pos + 1);
+
+  // the last column written
+  int last = VCF_SAMPLE_COLUMN - 1 + n_sample;
+  if (n_sample == 0) {
+    last = n_fmt > 0 ? VCF_FORMAT_COLUMN : VCF_INFO_COLUMN;
+  }
+  if (!this->all_columns) {
+    last = std::max(0, std::min<int>(last, this->columns.size() - 1));
+  }
+
+  // the variable fields are walked in order up to the last column
+  const uint8_t* p = shared + 24;
+  Typed id = {};
+  Typed filter = {};
+  this->alleles.clear();
+  this->infos.clear();
+  this->formats.clear();
+  if (last >= 2) {
+    this->read_typed(&p, end, &id);
+    p += id.count * type_size(id.type);
+  }
+  if (last >= 3) {
+    for (uint32_t i = 0; i < n_allele; i++) {
+      Typed allele;
+      this->read_typed(&p, end, &allele);
+      p += allele.count * type_size(allele.type);
+      this->alleles.push_back(allele);
+    }
+  }
+  if (last >= 6) {
+    this->read_typed(&p, end, &filter);
+    p += filter.count * type_size(filter.type);
+  }
+  if (last >= VCF_INFO_COLUMN) {
+    for (uint32_t i = 0; i < n_info; i++) {
+      int key = this->read_typed_int(&p, end);
+      Typed value;
+      this->read_typed(&p, end, &value);
+      p += value.count * type_size(value.type);
+      this->infos.emplace_back(key, value);
+    }
+  }
+  if (p > end) {
+    this->corrupt();
+  }
+  if (last >= VCF_FORMAT_COLUMN) {
+    const uint8_t* q = indiv;
+    const uint8_t* indiv_end = indiv + l_indiv;
+    for (uint32_t i = 0; i < n_fmt; i++) {
+      int key = this->read_typed_int(&q, indiv_end);
+      Typed value;
+      this->read_typed(&q, indiv_end, &value);
+      q += (size_t)n_sample * value.count * type_size(value.type);
+      this->formats.emplace_back(key, value);
+    }
+    if (q > indiv_end) {
+      this->corrupt();
+    }
+  }
+  for (auto& field : this->infos) {
+    if (field.first < 0 || field.first >= this->strings.size()) {
+      this->corrupt();
+    }
+  }
+  for (auto& field : this->formats) {
+    if (field.first < 0 || field.first >= this->strings.size()) {
+      this->corrupt();
+    }
+  }
+
+  auto text = &this->text;
+  for (int column = 0; column <= std::min(last, VCF_FORMAT_COLUMN);
+       column++) {
+    if (column > 0) {
+      text->push_back('\t');
+    }
+    if (!this->all_columns && !this->columns[column]) {
+      text->push_back('.');
+      continue;
+    }
+    switch (column) {
+    case 0:
+      text->append(this->contigs[chrom]);
+      break;
+    case 1:
+      this->commit_text(write_int(this->reserve_text(BCF_INT_TEXT), pos + 1));
+      break;
+    case 2:
+      this->append_values(id);
+      break;
+    case 3:
+      if (this->alleles.empty()) {
+        text->push_back('.');
+      } else {
+        this->append_values(this->alleles[0]);
+      }
+      break;
+    case 4:
+      if (this->alleles.size() < 2) {
+        text->push_back('.');
+      }
+      for (size_t i = 1; i < this->alleles.size(); i++) {
+        if (i > 1) {
+          text->push_back(',');
+        }
+        this->append_values(this->alleles[i]);
+      }
+      break;
+    case 5:
+      this->commit_text(write_float(this->reserve_text(BCF_FLOAT_TEXT), qual));
+      break;
+    case 6:
+      if (filter.count == 0) {
+        text->push_back('.');
+      }
+      for (uint32_t i = 0; i < filter.count; i++) {
+        bool missing, end;
+        int64_t v = int_at(filter.data, filter.type, i, &missing, &end);
+        if (v < 0 || v >= this->strings.size()) {
+          this->corrupt();
+        }
+        if (i > 0) {
+          text->push_back(';');
+        }
+        text->append(this->strings[v]);
+      }
+      break;
+    case VCF_INFO_COLUMN:
+      if (this->infos.empty()) {
+        text->push_back('.');
+      }
+      for (size_t i = 0; i < this->infos.size(); i++) {
+        auto& field = this->infos[i];
+        if (i > 0) {
+          text->push_back(';');
+        }
+        text->append(this->strings[field.first]);
+        bool flag = field.first < this->info_flags.size()
+                    && this->info_flags[field.first];
+        if (!flag && field.second.count > 0) {
+          text->push_back('=');
+          this->append_values(field.second);
+        }
+      }
+      break;
+    case VCF_FORMAT_COLUMN:
+      if (this->formats.empty()) {
+        text->push_back('.');
+      }
+      for (size_t i = 0; i < this->formats.size(); i++) {
+        if (i > 0) {
+          text->push_back(':');
+        }
+        text->append(this->strings[this->formats[i].first]);
+      }
+      break;
+    }
+  }
+  if (last < VCF_SAMPLE_COLUMN) {
+    return;
+  }
+
+  // the sample columns are written to one reserved piece of text, only the
+  // values of the samples used are read
+  size_t bound = 2;
+  for (auto& field : this->formats) {
+    bound += text_bound(field.second.type, field.second.count) + 1;
+  }
+  char* out = this->reserve_text(bound * (last - VCF_FORMAT_COLUMN));
+  for (int column = VCF_SAMPLE_COLUMN; column <= last; column++) {
+    *out++ = '\t';
+    if ((!this->all_columns && !this->columns[column])
+        || this->formats.empty()) {
+      *out++ = '.';
+      continue;
+    }
+    size_t sample = column - VCF_SAMPLE_COLUMN;
+    for (size_t i = 0; i < this->formats.size(); i++) {
+      auto& field = this->formats[i];
+      if (i > 0) {
+        *out++ = ':';
+      }
+      auto count = field.second.count;
+      if (field.first == this->genotype_key) {
+        out = write_genotype(out, field.second.type, field.second.data,
+                             sample * count, count);
+      } else {
+        out = write_values(out, field.second.type, field.second.data,
+                           sample * count, count);
+      }
+    }
+  }
+  this->commit_text(out);
+}
+
+LineBlock*
+BcfDataProvider::next_block() {
+  this->block.clear();
+  if (this->eof) {
+    return &this->block;
+  }
+  if (!this->header_read) {
+    this->read_header();
+  }
+  // the header lines come first
+  if (this->header_pos < this->header.size()) {
+    std::string_view header(this->header);
+    while (this->header_pos < header.size()) {
+      auto end = header.find('\n', this->header_pos);
+      if (end == std::string_view::npos) {
+        end = header.size();
+      }
+      this->line_number++;
+      if (end > this->header_pos) {
+        this->block.push(
+            header.substr(this->header_pos, end - this->header_pos),
+            this->line_number);
+      }
+      this->header_pos = end + 1;
+    }
+    if (!this->block.empty()) {
+      return &this->block;
+    }
+  }
+  // the views are made once the text is written, it may move before
+  this->text.clear();
+  this->line_ends.clear();
+  this->line_contigs.clear();
+  this->line_positions.clear();
+  while (this->text.size() < BCF_BLOCK_SIZE) {
+    if (!this->fill(8)) {
+      if (this->input_pos < this->input.size()) {
+        fprintf(stderr, "warning: %s is truncated\n", this->path.c_str());
+      }
+      break;
+    }
+    auto p = reinterpret_cast<const uint8_t*>(this->input.data())
+             + this->input_pos;
+    uint32_t l_shared = le32(p);
+    uint32_t l_indiv = le32(p + 4);
+    if (!this->fill(8 + (size_t)l_shared + l_indiv)) {
+      fprintf(stderr, "warning: %s is truncated\n", this->path.c_str());
+      break;
+    }
+    p = reinterpret_cast<const uint8_t*>(this->input.data()) + this->input_pos;
+    this->append_record(p + 8, l_shared, p + 8 + l_shared, l_indiv);
+    this->line_ends.push_back(this->text.size());
+    this->input_pos += 8 + (size_t)l_shared + l_indiv;
+  }
+  size_t start = 0;
+  for (auto end : this->line_ends) {
+    this->line_number++;
+    this->block.push(std::string_view(this->text.data() + start, end - start),
+                     this->line_number);
+    start = end;
+  }
+  this->memory.update(this->input.capacity() + this->text.capacity());
+  if (this->block.empty()) {
+    this->eof = true;
+  }
+  return &this->block;
+}
+
+} // namespace filterx
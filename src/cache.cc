@@ -0,0 +1,529 @@
+#include "cache.h"
+#include "param.h"
+
+#include <cerrno>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace filterx {
+
+static const uint64_t CACHE_ALIGN = 8;
+
+static inline uint64_t
+align_up(uint64_t n) {
+  return (n + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN;
+}
+
+bool
+is_cache_file(const char* head, size_t size) {
+  return size >= sizeof(CACHE_MAGIC)
+         && memcmp(head, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0;
+}
+
+CacheDataProvider::~CacheDataProvider() { this->close(); }
+
+bool
+CacheDataProvider::open(const std::string& path) {
+#ifdef _WIN32
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  char buff[1 << 16];
+  size_t n = 0;
+  while ((n = fread(buff, 1, sizeof(buff), file)) > 0) {
+    this->content.insert(this->content.end(), buff, buff + n);
+  }
+  fclose(file);
+  this->data = this->content.data();
+  this->size = this->content.size();
+  this->memory.update(this->content.capacity());
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+  this->size = st.st_size;
+  if (this->size > 0) {
+    void* p = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      ::close(fd);
+      return false;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(p, this->size, MADV_SEQUENTIAL);
+#endif
+    this->data = static_cast<const char*>(p);
+    this->mapped = true;
+  }
+  ::close(fd);
+#endif
+  if (!this->check_layout()) {
+    fprintf(stderr, "%s is not a valid cache file, rebuild it with "
+                    "`filterx cache build`\n",
+            path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  return true;
+}
+
+// offset of the text of the next row to read
+uint64_t
+CacheDataProvider::bytes_read() {
+  if (this->header == nullptr) {
+    return 0;
+  }
+  uint64_t row = this->next_row;
+  if (this->next_group_idx > 0) {
+    row = std::max(row, this->groups[this->next_group_idx]);
+  }
+  if (row >= this->header->nrows) {
+    return this->size;
+  }
+  return this->header->text_offset + this->rows[row].text_offset;
+}
+
+void
+CacheDataProvider::close() {
+#ifndef _WIN32
+  if (this->mapped) {
+    munmap(const_cast<char*>(this->data), this->size);
+    this->mapped = false;
+  }
+#endif
+  this->content.clear();
+  this->content.shrink_to_fit();
+  this->data = nullptr;
+  this->size = 0;
+}
+
+// every section must be aligned and lie inside the file
+bool
+CacheDataProvider::check_layout() {
+  if (this->size < sizeof(CacheHeader)
+      || !is_cache_file(this->data, this->size)) {
+    return false;
+  }
+  auto h = reinterpret_cast<const CacheHeader*>(this->data);
+  if (h->version != CACHE_VERSION || h->byte_order != CACHE_BYTE_ORDER
+      || h->file_size != this->size) {
+    return false;
+  }
+  auto check = [this](uint64_t offset, uint64_t n, uint64_t item_size) {
+    return offset % CACHE_ALIGN == 0 && offset <= this->size
+           && n <= (this->size - offset) / item_size;
+  };
+  if (h->ngroups > h->nrows || h->nkeys == 0
+      || !check(h->keys_offset, h->nkeys, sizeof(CacheKeySpec))
+      || !check(h->rows_offset, h->nrows, sizeof(CacheRow))
+      || !check(h->index_offset, h->nindex, sizeof(uint32_t))
+      || !check(h->values_offset, h->nrows, h->nkeys * sizeof(KeyValue))
+      || !check(h->groups_offset, h->ngroups + 1, sizeof(uint64_t))
+      || !check(h->text_offset, h->text_size, 1)
+      || !check(h->comment_offset, h->comment_size, 1)) {
+    return false;
+  }
+  this->header = h;
+  this->keys
+      = reinterpret_cast<const CacheKeySpec*>(this->data + h->keys_offset);
+  this->rows = reinterpret_cast<const CacheRow*>(this->data + h->rows_offset);
+  this->index
+      = reinterpret_cast<const uint32_t*>(this->data + h->index_offset);
+  this->values
+      = reinterpret_cast<const KeyValue*>(this->data + h->values_offset);
+  this->groups
+      = reinterpret_cast<const uint64_t*>(this->data + h->groups_offset);
+  this->text = this->data + h->text_offset;
+  this->comments = this->data + h->comment_offset;
+  return this->groups[h->ngroups] == h->nrows;
+}
+
+bool
+CacheDataProvider::matches(char separator, std::vector<uint32_t>& row_keys,
+                           std::vector<RowKeyType>& key_types,
+                           std::vector<RowKeySortOrder>& sort_order) {
+  if (separator != this->header->separator
+      || row_keys.size() != this->header->nkeys
+      || key_types.size() != this->header->nkeys
+      || sort_order.size() != this->header->nkeys) {
+    return false;
+  }
+  for (size_t i = 0; i < row_keys.size(); i++) {
+    if (row_keys[i] != this->keys[i].column
+        || key_types[i] != this->keys[i].type
+        || sort_order[i] != this->keys[i].order) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+CacheDataProvider::next_group(uint64_t* begin, uint64_t* end) {
+  if (this->next_group_idx >= this->header->ngroups) {
+    return false;
+  }
+  *begin = this->groups[this->next_group_idx];
+  *end = this->groups[this->next_group_idx + 1];
+  this->next_group_idx++;
+  if (*begin > *end || *end > this->header->nrows) {
+    fprintf(stderr, "cache file is corrupted: bad group %lu\n",
+            (unsigned long)this->next_group_idx);
+    exit(EXIT_FAILURE);
+  }
+  return true;
+}
+
+void
+CacheDataProvider::load_row(uint64_t n, Row* row) {
+  auto r = &this->rows[n];
+  if (r->text_offset > this->header->text_size
+      || r->text_length > this->header->text_size - r->text_offset
+      || r->index_offset > this->header->nindex
+      || r->nindex > this->header->nindex - r->index_offset) {
+    fprintf(stderr, "cache file is corrupted: bad row %lu\n",
+            (unsigned long)n);
+    exit(EXIT_FAILURE);
+  }
+  row->set_splited_row(this->text + r->text_offset, r->text_length,
+                       this->index + r->index_offset, r->nindex);
+  row->row_idx = r->line_number;
+  auto values = this->values + n * this->header->nkeys;
+  for (uint32_t i = 0; i < this->header->nkeys && i < ROW_KEY_CACHE_SIZE;
+       i++) {
+    if (r->cached_keys & (1u << i)) {
+      row->set_cached_key(i, values[i]);
+    }
+  }
+}
+
+// rows of a text block
+static const size_t CACHE_BLOCK_SIZE = 128 << 10;
+
+LineBlock*
+CacheDataProvider::next_block() {
+  this->block.clear();
+  if (this->comment_pos < this->header->comment_size) {
+    // comment lines are handed out from the cache directly
+    std::string_view comments(this->comments, this->header->comment_size);
+    while (this->comment_pos < comments.size()) {
+      auto end = comments.find('\n', this->comment_pos);
+      if (end == std::string_view::npos) {
+        end = comments.size();
+      }
+      if (end > this->comment_pos) {
+        this->block.push(
+            comments.substr(this->comment_pos, end - this->comment_pos), 0);
+      }
+      this->comment_pos = end + 1;
+    }
+    if (!this->block.empty()) {
+      return &this->block;
+    }
+  }
+  // the text of the rows is restored into one buffer, so the views are
+  // made once it is filled
+  uint64_t first = this->next_row;
+  size_t size = 0;
+  while (this->next_row < this->header->nrows && size < CACHE_BLOCK_SIZE) {
+    auto r = &this->rows[this->next_row];
+    if (r->text_offset > this->header->text_size
+        || r->text_length > this->header->text_size - r->text_offset) {
+      fprintf(stderr, "cache file is corrupted: bad row %lu\n",
+              (unsigned long)this->next_row);
+      exit(EXIT_FAILURE);
+    }
+    size += r->text_length;
+    this->next_row++;
+  }
+  this->lines_text.resize(size);
+  size_t pos = 0;
+  for (auto n = first; n < this->next_row; n++) {
+    auto r = &this->rows[n];
+    char* line = &this->lines_text[pos];
+    memcpy(line, this->text + r->text_offset, r->text_length);
+    for (uint32_t i = 0; i < r->text_length; i++) {
+      if (line[i] == '\0') {
+        line[i] = this->header->separator;
+      }
+    }
+    if (r->text_length > 0) {
+      this->block.push(std::string_view(line, r->text_length),
+                       r->line_number);
+    }
+    pos += r->text_length;
+  }
+  this->memory.update(this->lines_text.capacity());
+  if (this->block.empty() && this->next_row >= this->header->nrows) {
+    this->eof = true;
+  }
+  return &this->block;
+}
+
+// a section is written to a temporary file while the input is read, the
+// sections are joined once their sizes are known
+class CacheSection {
+public:
+  CacheSection() {
+    this->file = tmpfile();
+    if (this->file == nullptr) {
+      fprintf(stderr, "failed to create a temporary file for the cache: %s\n",
+              strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+  ~CacheSection() { fclose(this->file); }
+
+  void
+  write(const void* data, size_t size) {
+    if (size > 0 && fwrite(data, 1, size, this->file) != size) {
+      fprintf(stderr, "failed to write the cache: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    this->size += size;
+  }
+
+  // append the section to output at an aligned offset, returns the offset
+  uint64_t
+  copy_to(FILE* output, uint64_t* offset) {
+    static const char padding[CACHE_ALIGN] = { 0 };
+    uint64_t start = align_up(*offset);
+    if (start > *offset) {
+      fwrite(padding, 1, start - *offset, output);
+    }
+    rewind(this->file);
+    char buff[1 << 16];
+    size_t n = 0;
+    while ((n = fread(buff, 1, sizeof(buff), this->file)) > 0) {
+      if (fwrite(buff, 1, n, output) != n) {
+        fprintf(stderr, "failed to write the cache: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+      }
+    }
+    *offset = start + this->size;
+    return start;
+  }
+
+  uint64_t size = 0;
+
+private:
+  FILE* file;
+};
+
+static void
+build_cache(FileParams* params, const std::string& output_path) {
+  auto provider = createDataProvider(params->path);
+  if (provider == nullptr) {
+    fprintf(stderr, "failed to open %s\n", params->path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  if (dynamic_cast<CacheDataProvider*>(provider) != nullptr) {
+    fprintf(stderr, "%s is a cache file already\n", params->path.c_str());
+    exit(EXIT_FAILURE);
+  }
+
+  for (auto type : params->key_types) {
+    if (type == RowKeyTypeContig) {
+      fprintf(stderr, "contig keys can not be cached, the contig order is "
+                      "only known when merging\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (auto column : params->row_keys) {
+    if (column >= ROW_FIELD_COLUMN) {
+      fprintf(stderr, "VCF field keys can not be cached\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  CacheSection key_specs, rows, index, values, groups, text, comments;
+  uint32_t nkeys = params->row_keys.size();
+  for (uint32_t i = 0; i < nkeys; i++) {
+    CacheKeySpec spec = { params->row_keys[i],
+                          static_cast<uint32_t>(params->key_types[i]),
+                          static_cast<uint32_t>(params->sort_order[i]), 0 };
+    key_specs.write(&spec, sizeof(spec));
+  }
+
+  Row row;
+  Row prev;
+  row.set_separator(params->separator);
+  prev.set_separator(params->separator);
+  RowKey key1(params->row_keys, params->key_types, params->sort_order);
+  RowKey key2(params->row_keys, params->key_types, params->sort_order);
+  std::vector<KeyValue> row_values(nkeys);
+  uint64_t nrows = 0;
+  uint64_t ngroups = 0;
+  uint64_t nindex = 0;
+  const char end_of_row = '\0';
+  const char newline = '\n';
+
+  while (1) {
+    auto line = provider->readline();
+    if (!line.has_value()) {
+      break;
+    }
+    if (line.value()[0] == params->comment) {
+      comments.write(line.value().data(), line.value().size());
+      comments.write(&newline, 1);
+      continue;
+    }
+    row.set_row(line.value());
+    row.row_idx = provider->line_number;
+    row.split();
+
+    // rows are grouped the same way RowBuffer does
+    key2.update_row(&row);
+    bool new_group = nrows == 0;
+    if (!new_group) {
+      key1.update_row(&prev);
+      new_group = !key1.equals(&key2);
+    }
+    if (new_group) {
+      groups.write(&nrows, sizeof(nrows));
+      ngroups++;
+    }
+
+    CacheRow r = {};
+    for (uint32_t i = 0; i < nkeys; i++) {
+      row_values[i].int_value = 0;
+      auto key = key2.get_key(i).value_or(nullptr);
+      if (key == nullptr || key->type == RowKeyTypeString || i >= 32) {
+        continue;
+      }
+      if (key->type == RowKeyTypeInt) {
+        row_values[i].int_value = key->to_int();
+      } else {
+        row_values[i].float_value = key->to_float();
+      }
+      r.cached_keys |= 1u << i;
+    }
+    values.write(row_values.data(), nkeys * sizeof(KeyValue));
+
+    auto row_text = row.splited_text();
+    auto& row_index = row.splited_index();
+    r.text_offset = text.size;
+    r.text_length = row_text.size();
+    r.index_offset = nindex;
+    r.nindex = row_index.size();
+    r.line_number = row.row_idx;
+    rows.write(&r, sizeof(r));
+    index.write(row_index.data(), row_index.size() * sizeof(uint32_t));
+    text.write(row_text.data(), row_text.size());
+    text.write(&end_of_row, 1);
+    nindex += row_index.size();
+    nrows++;
+    std::swap(row, prev);
+  }
+  groups.write(&nrows, sizeof(nrows));
+  delete provider;
+
+  FILE* output = fopen(output_path.c_str(), "wb");
+  if (output == nullptr) {
+    fprintf(stderr, "failed to open %s: %s\n", output_path.c_str(),
+            strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  CacheHeader header = {};
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.byte_order = CACHE_BYTE_ORDER;
+  header.nkeys = nkeys;
+  header.separator = params->separator;
+  header.comment = params->comment;
+  header.nrows = nrows;
+  header.ngroups = ngroups;
+  header.nindex = nindex;
+  header.text_size = text.size;
+  header.comment_size = comments.size;
+  fwrite(&header, sizeof(header), 1, output);
+
+  uint64_t offset = sizeof(header);
+  header.keys_offset = key_specs.copy_to(output, &offset);
+  header.rows_offset = rows.copy_to(output, &offset);
+  header.index_offset = index.copy_to(output, &offset);
+  header.values_offset = values.copy_to(output, &offset);
+  header.groups_offset = groups.copy_to(output, &offset);
+  header.text_offset = text.copy_to(output, &offset);
+  header.comment_offset = comments.copy_to(output, &offset);
+  header.file_size = offset;
+
+  rewind(output);
+  if (fwrite(&header, sizeof(header), 1, output) != 1 || fclose(output) != 0) {
+    fprintf(stderr, "failed to write %s: %s\n", output_path.c_str(),
+            strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  fprintf(stderr, "%s: %lu rows, %lu groups\n", output_path.c_str(),
+          (unsigned long)nrows, (unsigned long)ngroups);
+}
+
+static void
+cache_help() {
+  fprintf(stderr, "Usage: filterx cache build [-o <output>] <file:attributes>\n");
+  fprintf(stderr, "  Convert file into a cache that queries with the same keys "
+                  "(k) and separator (s) read without parsing text.\n");
+  fprintf(stderr, "  -o: output path, default is <file>.fxc\n");
+}
+
+int
+cache_main(int argc, char** argv) {
+  if (argc < 2 || strcmp(argv[1], "build") != 0) {
+    cache_help();
+    exit(EXIT_FAILURE);
+  }
+  const char* input = nullptr;
+  std::string output_path;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "-o requires a path\n");
+        exit(EXIT_FAILURE);
+      }
+      output_path = argv[++i];
+      continue;
+    }
+    if (argv[i][0] == '-') {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      cache_help();
+      exit(EXIT_FAILURE);
+    }
+    if (input != nullptr) {
+      fprintf(stderr, "cache build takes one input file\n");
+      exit(EXIT_FAILURE);
+    }
+    input = argv[i];
+  }
+  if (input == nullptr) {
+    cache_help();
+    exit(EXIT_FAILURE);
+  }
+  auto params = parse_cache_file_params(input);
+  if (output_path.empty() && is_shards_path(params.path)) {
+    fprintf(stderr, "the cache of shards needs an output path, set it "
+                    "with -o\n");
+    exit(EXIT_FAILURE);
+  }
+  if (output_path.empty()) {
+    output_path = params.path + ".fxc";
+  }
+  if (output_path == params.path) {
+    fprintf(stderr, "cache output would overwrite its input %s\n",
+            params.path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  build_cache(&params, output_path);
+  return 0;
+}
+
+} // namespace filterx
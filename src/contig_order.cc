@@ -0,0 +1,147 @@
+#include "contig_order.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "data_provider.h"
+
+namespace filterx {
+
+ContigOrder contig_order;
+
+static const std::string_view CONTIG_HEADER = "##contig=<";
+
+std::string_view
+contig_header_id(std::string_view line) {
+  if (line.substr(0, CONTIG_HEADER.size()) != CONTIG_HEADER) {
+    return std::string_view();
+  }
+  auto fields = line.substr(CONTIG_HEADER.size());
+  size_t pos = 0;
+  while (pos < fields.size()) {
+    auto end = fields.find_first_of(",>", pos);
+    if (end == std::string_view::npos) {
+      end = fields.size();
+    }
+    auto field = fields.substr(pos, end - pos);
+    if (field.substr(0, 3) == "ID=") {
+      return field.substr(3);
+    }
+    pos = end + 1;
+  }
+  return std::string_view();
+}
+
+// the name of a line of a contig list: the ID of a ##contig line, SN of a
+// @SQ line or the first column of a .fai, chrom sizes or plain list
+static std::string_view
+contig_list_name(std::string_view line) {
+  if (line[0] == '#') {
+    return contig_header_id(line);
+  }
+  if (line[0] == '@') {
+    if (line.substr(0, 4) != "@SQ\t") {
+      return std::string_view();
+    }
+    auto pos = line.find("\tSN:");
+    if (pos == std::string_view::npos) {
+      return std::string_view();
+    }
+    auto name = line.substr(pos + 4);
+    return name.substr(0, name.find('\t'));
+  }
+  return line.substr(0, line.find_first_of("\t "));
+}
+
+void
+ContigOrder::load(const std::string& path) {
+  auto provider = createDataProvider(path, false);
+  if (provider == nullptr) {
+    fprintf(stderr, "failed to open contig list %s\n", path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  while (1) {
+    auto line = provider->readline();
+    if (!line.has_value()) {
+      break;
+    }
+    auto text = line.value();
+    if (text.empty() || text[0] == '\r') {
+      continue;
+    }
+    // the rows of a VCF follow its header
+    if (text.substr(0, 6) == "#CHROM") {
+      break;
+    }
+    auto name = contig_list_name(text);
+    if (!name.empty() && name.back() == '\r') {
+      name.remove_suffix(1);
+    }
+    if (!name.empty() && this->ranks.find(name) == this->ranks.end()) {
+      this->add(name);
+    }
+  }
+  delete provider;
+  if (this->names.empty()) {
+    fprintf(stderr, "no contigs found in %s\n", path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  this->loaded = true;
+}
+
+void
+ContigOrder::add_header_line(std::string_view line, int64_t* last,
+                             const std::string& path) {
+  if (this->loaded) {
+    return;
+  }
+  auto name = contig_header_id(line);
+  if (name.empty()) {
+    return;
+  }
+  auto it = this->ranks.find(name);
+  int64_t rank = 0;
+  if (it == this->ranks.end()) {
+    // a new contig can only be appended after the last known one
+    if (*last != (int64_t)this->names.size() - 1) {
+      fprintf(stderr,
+              "contig %.*s of %s is not in the ##contig lines of the files "
+              "before, use --contigs to give the order\n",
+              (int)name.size(), name.data(), path.c_str());
+      exit(EXIT_FAILURE);
+    }
+    rank = this->add(name);
+  } else {
+    rank = it->second;
+    if (rank <= *last) {
+      fprintf(stderr,
+              "contig order of %s differs from the files before at %.*s, use "
+              "--contigs to give the order\n",
+              path.c_str(), (int)name.size(), name.data());
+      exit(EXIT_FAILURE);
+    }
+  }
+  *last = rank;
+}
+
+int64_t
+ContigOrder::add(std::string_view name) {
+  this->names.emplace_back(name);
+  int64_t rank = this->names.size() - 1;
+  this->ranks.emplace(this->names.back(), rank);
+  return rank;
+}
+
+void
+ContigOrder::unknown(std::string_view name) {
+  fprintf(stderr, "unknown contig: %.*s\n", (int)name.size(), name.data());
+  if (this->loaded) {
+    fprintf(stderr, "it is not in the file of --contigs\n");
+  } else {
+    fprintf(stderr, "it has no ##contig header line, use --contigs to give "
+                    "the order\n");
+  }
+  exit(EXIT_FAILURE);
+}
+
+} // namespace filterx
@@ -1,118 +1,510 @@
 #include "data_provider.h"
+#include "bcf.h"
+#include "cache.h"
+#include "stats.h"
+#include "trace.h"
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <glob.h>
+#endif
 
 namespace filterx {
 
+// bytes read at once, less once the memory budget is reached
+static const size_t DATA_BLOCK_SIZE = 128 << 10;
+static const size_t DATA_PRESSURE_BLOCK_SIZE = 8 << 10;
+
+LineBlock*
+DataProvider::next_block() {
+  this->block.clear();
+  while (!this->eof) {
+    // drop the lines handed out before, keep the partial line
+    if (this->start > 0) {
+      this->buffer.erase(0, this->start);
+      this->start = 0;
+    }
+    if (!this->raw_eof) {
+      // small files, like thousands of shards, never get a full block
+      size_t read_size = memory_governor.over_budget()
+                             ? DATA_PRESSURE_BLOCK_SIZE
+                             : std::min(DATA_BLOCK_SIZE,
+                                        std::max(DATA_PRESSURE_BLOCK_SIZE,
+                                                 this->raw_bytes));
+      size_t used = this->buffer.size();
+      this->buffer.resize(used + read_size);
+      size_t n = this->read_raw(&this->buffer[used], read_size);
+      this->buffer.resize(used + n);
+      this->raw_bytes += n;
+      this->raw_eof = n == 0;
+      if (this->buffer.capacity() > 4 * read_size
+          && this->buffer.size() < read_size) {
+        this->buffer.shrink_to_fit();
+      }
+      this->memory.update(this->buffer.capacity());
+    }
+    const char* data = this->buffer.data();
+    size_t size = this->buffer.size();
+    size_t pos = 0;
+    while (pos < size) {
+      auto newline
+          = static_cast<const char*>(memchr(data + pos, '\n', size - pos));
+      if (newline == nullptr) {
+        break;
+      }
+      size_t end = newline - data;
+      this->line_number++;
+      if (end > pos) {
+        this->block.push(std::string_view(data + pos, end - pos),
+                         this->line_number);
+      }
+      pos = end + 1;
+    }
+    if (this->raw_eof && pos < size) {
+      // the last line has no newline
+      this->line_number++;
+      this->block.push(std::string_view(data + pos, size - pos),
+                       this->line_number);
+      pos = size;
+    }
+    this->start = pos;
+    if (!this->block.empty()) {
+      break;
+    }
+    if (this->raw_eof) {
+      this->eof = true;
+      std::string().swap(this->buffer);
+      this->memory.update(0);
+    }
+  }
+  return &this->block;
+}
+
+std::optional<std::string_view>
+DataProvider::readline() {
+  while (this->readline_pos >= this->block.size()) {
+    this->readline_pos = 0;
+    if (this->next_block()->empty()) {
+      return std::nullopt;
+    }
+  }
+  this->line_number = this->block.line_numbers[this->readline_pos];
+  return this->block.lines[this->readline_pos++];
+}
+
 PlainDataProvider::~PlainDataProvider() { this->close(); }
 
 bool
 PlainDataProvider::open(const std::string& path) {
-  this->file.open(path, std::ios::in);
-  return this->file.is_open();
+  auto source = open_file_source(path);
+  if (source == nullptr) {
+    return false;
+  }
+  this->attach(source);
+  return true;
+}
+
+void
+PlainDataProvider::attach(FileSource* source) {
+  this->source = source;
 }
 
 void
 PlainDataProvider::close() {
-  if (this->file.is_open()) {
-    this->file.close();
-  }
+  delete this->source;
+  this->source = nullptr;
 }
 
-std::optional<std::string_view>
-PlainDataProvider::readline() {
-  if (this->eof) {
-    return std::nullopt;
-  }
-  while (1) {
-    std::getline(this->file, this->line);
-    if (this->file.eof()) {
-      this->eof = true;
-      return std::nullopt;
-    }
-    this->line_number++;
-    if (this->line.empty()) {
-      continue;
-    }
-    break;
-  }
-  return this->line;
+size_t
+PlainDataProvider::read_raw(char* buffer, size_t size) {
+  return this->source->read(buffer, size);
+}
+
+uint64_t
+PlainDataProvider::bytes_read() {
+  return this->source ? this->source->offset : 0;
+}
+
+uint64_t
+PlainDataProvider::total_bytes() {
+  return this->source ? file_size(this->source->path) : 0;
 }
 
 GzipDataProvider::~GzipDataProvider() { this->close(); }
 
+uint64_t
+GzipDataProvider::bytes_read() {
+  return this->source ? this->source->offset : 0;
+}
+
+uint64_t
+GzipDataProvider::total_bytes() {
+  return this->source ? file_size(this->source->path) : 0;
+}
+
 bool
 GzipDataProvider::open(const std::string& path) {
-  file = gzopen(path.c_str(), "rb");
-  return file != nullptr;
+  auto source = open_file_source(path);
+  if (source == nullptr) {
+    return false;
+  }
+  this->attach(source);
+  return true;
+}
+
+void
+GzipDataProvider::attach(FileSource* source) {
+  this->source = source;
+  memset(&this->stream, 0, sizeof(this->stream));
+  // 15 + 32, a gzip or zlib header is detected
+  if (inflateInit2(&this->stream, 15 + 32) != Z_OK) {
+    fprintf(stderr, "Failed to decompress file %s\n", source->path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  this->stream_init = true;
+  this->stream_end = false;
 }
 
 void
 GzipDataProvider::close() {
-  if (file) {
-    gzclose(file);
-    file = nullptr;
+  if (this->stream_init) {
+    inflateEnd(&this->stream);
+    this->stream_init = false;
   }
+  delete this->source;
+  this->source = nullptr;
 }
 
-std::optional<std::string_view>
-GzipDataProvider::readline() {
-  if (this->eof) {
-    return std::nullopt;
-  }
-  this->line.clear();
-  while (true) {
-    int read = gzread(file, buff, sizeof(buff));
-    if (read == 0) {
-      if (!this->decompressed_buff.empty()) {
-        this->line = this->decompressed_buff;
-        this->decompressed_buff.clear();
-        return this->line;
-      } else {
-        this->eof = true;
-        return std::nullopt;
+size_t
+GzipDataProvider::read_raw(char* buffer, size_t size) {
+  StageScope scope(StageDecompress);
+  auto stream = &this->stream;
+  stream->next_out = reinterpret_cast<Bytef*>(buffer);
+  stream->avail_out = size;
+  while (stream->avail_out > 0 && !this->stream_end) {
+    if (stream->avail_in == 0) {
+      const char* data;
+      size_t n;
+      if (!this->source->next_chunk(&data, &n)) {
+        // the input ends in the middle of a member
+        fprintf(stderr, "warning: %s is truncated\n",
+                this->source->path.c_str());
+        this->stream_end = true;
+        break;
       }
+      stream->next_in
+          = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+      stream->avail_in = n;
     }
-    this->decompressed_buff.append(buff, read);
-    auto pos = this->decompressed_buff.find('\n');
-    if (pos != std::string::npos) {
-      this->line = this->decompressed_buff.substr(0, pos);
-      this->decompressed_buff.erase(0, pos + 1);
-      break;
+    int ret = inflate(stream, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      // another member may follow, anything else after a member is ignored
+      // like gzread does
+      if (stream->avail_in == 0) {
+        const char* data;
+        size_t n;
+        if (!this->source->next_chunk(&data, &n)) {
+          this->stream_end = true;
+          break;
+        }
+        stream->next_in
+            = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        stream->avail_in = n;
+      }
+      if (stream->next_in[0] != 0x1f) {
+        this->stream_end = true;
+        break;
+      }
+      inflateReset(stream);
+      continue;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      fprintf(stderr, "Failed to decompress file %s, message: %s\n",
+              this->source->path.c_str(),
+              stream->msg ? stream->msg : "unknown");
+      exit(EXIT_FAILURE);
     }
   }
-  this->line_number++;
-  if (this->line.empty()) {
-    return std::nullopt;
-  }
-  return this->line;
+  return size - stream->avail_out;
 }
 
+// the file is opened once, its head tells the format and is read again by
+// the provider
 DataProvider*
-createDataProvider(const std::string& path) {
-  std::ifstream file(path);
-  if (!file.is_open()) {
+createDataProvider(const std::string& path, bool pooled) {
+  if (is_shards_path(path)) {
+    auto data_provider = new ShardDataProvider();
+    if (!data_provider->open(path)) {
+      delete data_provider;
+      return nullptr;
+    }
+    return data_provider;
+  }
+  auto source = open_file_source(path, pooled);
+  if (source == nullptr) {
     auto error = errno;
-    auto error_msg = strerror(error);
-    std::cerr << "Failed to open file " << path << ", message: " << error_msg
-              << std::endl;
+    if (error == ENOENT) {
+      fprintf(stderr, "file %s does not exist\n", path.c_str());
+    } else {
+      fprintf(stderr, "Failed to open file %s, message: %s\n", path.c_str(),
+              strerror(error));
+    }
     exit(EXIT_FAILURE);
   }
-  char buff[2];
-  file.read(buff, 2);
-  file.close();
+  auto head = source->head();
 
-  DataProvider* data_provider = nullptr;
-  if (static_cast<unsigned char>(buff[0]) == 0x1f
-      && static_cast<unsigned char>(buff[1]) == 0x8b) {
-    data_provider = new GzipDataProvider();
+  if (is_bcf_file(head.data(), head.size())) {
+    auto data_provider = new BcfDataProvider();
+    data_provider->attach(source);
+    return data_provider;
+  }
+  if (head.size() >= 2 && static_cast<unsigned char>(head[0]) == 0x1f
+      && static_cast<unsigned char>(head[1]) == 0x8b) {
+    auto data_provider = new GzipDataProvider();
+    data_provider->attach(source);
+    return data_provider;
+  }
+  if (is_cache_file(head.data(), head.size())) {
+    // a cache is mapped as a whole, it does not keep a descriptor
+    delete source;
+    auto data_provider = new CacheDataProvider();
+    if (!data_provider->open(path)) {
+      delete data_provider;
+      return nullptr;
+    }
+    return data_provider;
+  }
+  auto data_provider = new PlainDataProvider();
+  data_provider->attach(source);
+  return data_provider;
+}
+
+// bytes of a shard read ahead
+static const size_t SHARD_PREFETCH_SIZE = 256 << 10;
+
+bool
+is_shards_path(const std::string& path) {
+  return path.compare(0, sizeof(SHARDS_PREFIX) - 1, SHARDS_PREFIX) == 0;
+}
+
+// digits compare as numbers, so part-9 comes before part-10
+static bool
+natural_less(const std::string& a, const std::string& b) {
+  size_t i = 0, j = 0;
+  while (i < a.size() && j < b.size()) {
+    if (isdigit(static_cast<unsigned char>(a[i]))
+        && isdigit(static_cast<unsigned char>(b[j]))) {
+      size_t si = i, sj = j;
+      while (si < a.size() && a[si] == '0') {
+        si++;
+      }
+      while (sj < b.size() && b[sj] == '0') {
+        sj++;
+      }
+      size_t ei = si, ej = sj;
+      while (ei < a.size() && isdigit(static_cast<unsigned char>(a[ei]))) {
+        ei++;
+      }
+      while (ej < b.size() && isdigit(static_cast<unsigned char>(b[ej]))) {
+        ej++;
+      }
+      if (ei - si != ej - sj) {
+        return ei - si < ej - sj;
+      }
+      int c = a.compare(si, ei - si, b, sj, ej - sj);
+      if (c != 0) {
+        return c < 0;
+      }
+      i = ei;
+      j = ej;
+      continue;
+    }
+    if (a[i] != b[j]) {
+      return static_cast<unsigned char>(a[i])
+             < static_cast<unsigned char>(b[j]);
+    }
+    i++;
+    j++;
+  }
+  return a.size() - i < b.size() - j;
+}
+
+// patterns are separated by commas. windows has no glob, there the
+// patterns are the file names
+static std::vector<std::string>
+expand_shards(const std::string& path) {
+  std::vector<std::string> paths;
+  std::string patterns = path.substr(sizeof(SHARDS_PREFIX) - 1);
+  size_t start = 0;
+  while (start <= patterns.size()) {
+    size_t end = patterns.find(',', start);
+    if (end == std::string::npos) {
+      end = patterns.size();
+    }
+    std::string pattern = patterns.substr(start, end - start);
+    start = end + 1;
+    if (pattern.empty()) {
+      continue;
+    }
+#ifdef _WIN32
+    paths.push_back(pattern);
+#else
+    glob_t matches;
+    int ret = glob(pattern.c_str(), GLOB_NOSORT, nullptr, &matches);
+    if (ret == GLOB_NOMATCH) {
+      fprintf(stderr, "shards %s match no file\n", pattern.c_str());
+      exit(EXIT_FAILURE);
+    }
+    if (ret != 0) {
+      fprintf(stderr, "Failed to list shards %s\n", pattern.c_str());
+      exit(EXIT_FAILURE);
+    }
+    std::vector<std::string> files(matches.gl_pathv,
+                                   matches.gl_pathv + matches.gl_pathc);
+    globfree(&matches);
+    std::sort(files.begin(), files.end(), natural_less);
+    paths.insert(paths.end(), files.begin(), files.end());
+#endif
+  }
+  if (paths.empty()) {
+    fprintf(stderr, "shards of %s are empty\n", path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  return paths;
+}
+
+static DataProvider*
+open_shard(const std::string& path, bool pooled) {
+  auto provider = createDataProvider(path, pooled);
+  if (provider == nullptr || provider->file_source() == nullptr) {
+    fprintf(stderr, "shard %s should be a plain or gzip file\n",
+            path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  return provider;
+}
+
+ShardDataProvider::~ShardDataProvider() { this->close(); }
+
+uint64_t
+ShardDataProvider::bytes_read() {
+  return this->shard_bytes
+         + (this->current ? this->current->bytes_read() : 0);
+}
+
+uint64_t
+ShardDataProvider::total_bytes() {
+  uint64_t total = 0;
+  for (auto& path : this->paths) {
+    total += file_size(path);
+  }
+  return total;
+}
+
+bool
+ShardDataProvider::open(const std::string& path) {
+  this->paths = expand_shards(path);
+  this->next = 0;
+  return this->next_shard();
+}
+
+void
+ShardDataProvider::close() {
+  if (this->prefetch.thread.joinable()) {
+    this->prefetch.thread.join();
+  }
+  delete this->prefetch.provider;
+  this->prefetch.provider = nullptr;
+  delete this->current;
+  this->current = nullptr;
+  std::string().swap(this->head);
+  this->head_memory.update(0);
+}
+
+void
+ShardDataProvider::start_prefetch() {
+  if (this->next >= this->paths.size()) {
+    return;
+  }
+  auto prefetch = &this->prefetch;
+  auto path = this->paths[this->next];
+  // paths lives as long as the trace
+  auto name = this->paths[this->next].c_str();
+  prefetch->thread = std::thread([prefetch, path, name]() {
+    tracer.name_thread("prefetch");
+    TraceSpan span("prefetch", "read", name);
+    prefetch->provider = open_shard(path, false);
+    prefetch->head.resize(SHARD_PREFETCH_SIZE);
+    size_t used = 0;
+    while (used < prefetch->head.size()) {
+      size_t n = prefetch->provider->read_raw(&prefetch->head[used],
+                                              prefetch->head.size() - used);
+      if (n == 0) {
+        break;
+      }
+      used += n;
+    }
+    prefetch->head.resize(used);
+  });
+}
+
+bool
+ShardDataProvider::next_shard() {
+  if (this->next >= this->paths.size()) {
+    return false;
+  }
+  if (this->prefetch.thread.joinable()) {
+    this->prefetch.thread.join();
+    this->current = this->prefetch.provider;
+    this->prefetch.provider = nullptr;
+    this->current->file_source()->set_pooled(true);
+    this->head.swap(this->prefetch.head);
+    std::string().swap(this->prefetch.head);
   } else {
-    data_provider = new PlainDataProvider();
+    this->current = open_shard(this->paths[this->next], true);
+    this->head.clear();
   }
+  this->head_pos = 0;
+  this->head_memory.update(this->head.capacity());
+  this->last_byte = '\n';
+  this->next++;
+  this->start_prefetch();
+  return true;
+}
 
-  if (!data_provider->open(path)) {
-    delete data_provider;
-    return nullptr;
+size_t
+ShardDataProvider::read_raw(char* buffer, size_t size) {
+  while (1) {
+    if (this->current == nullptr && !this->next_shard()) {
+      return 0;
+    }
+    size_t n = 0;
+    if (this->head_pos < this->head.size()) {
+      n = std::min(size, this->head.size() - this->head_pos);
+      memcpy(buffer, this->head.data() + this->head_pos, n);
+      this->head_pos += n;
+      if (this->head_pos == this->head.size()) {
+        std::string().swap(this->head);
+        this->head_pos = 0;
+        this->head_memory.update(0);
+      }
+    } else {
+      n = this->current->read_raw(buffer, size);
+    }
+    if (n > 0) {
+      this->last_byte = buffer[n - 1];
+      return n;
+    }
+    this->shard_bytes += this->current->bytes_read();
+    delete this->current;
+    this->current = nullptr;
+    if (this->last_byte != '\n') {
+      this->last_byte = '\n';
+      buffer[0] = '\n';
+      return 1;
+    }
   }
-  return data_provider;
 }
 
 } // namespace filterx
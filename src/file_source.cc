@@ -0,0 +1,730 @@
+#include "file_source.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#ifdef __NR_io_uring_setup
+#define FILTERX_URING 1
+#endif
+#endif
+#endif
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef FILTERX_URING
+#include <deque>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+
+namespace filterx {
+
+// bytes read at once, the head of a file is smaller as every input is
+// opened at startup to tell its format
+static const size_t FILE_CHUNK_SIZE = 128 << 10;
+static const size_t FILE_HEAD_SIZE = 4 << 10;
+
+// descriptors of the files read recently, in the order they are used. once
+// there are too many the least recently used file is closed, so thousands
+// of inputs can be merged with the default limit of open files
+class FdPool {
+public:
+  void
+  touch(FileSource* source) {
+    if (this->first == source) {
+      return;
+    }
+    if (source->pooled) {
+      this->unlink(source);
+    } else {
+      source->pooled = true;
+      this->count++;
+    }
+    source->lru_next = this->first;
+    if (this->first) {
+      this->first->lru_prev = source;
+    }
+    this->first = source;
+    if (this->last == nullptr) {
+      this->last = source;
+    }
+    if (this->capacity == 0) {
+      this->capacity = fd_pool_capacity();
+    }
+    while (this->count > this->capacity) {
+      auto victim = this->last;
+      this->remove(victim);
+      victim->release();
+    }
+  }
+
+  void
+  remove(FileSource* source) {
+    if (!source->pooled) {
+      return;
+    }
+    this->unlink(source);
+    source->pooled = false;
+    this->count--;
+  }
+
+private:
+  void
+  unlink(FileSource* source) {
+    if (source->lru_prev) {
+      source->lru_prev->lru_next = source->lru_next;
+    } else {
+      this->first = source->lru_next;
+    }
+    if (source->lru_next) {
+      source->lru_next->lru_prev = source->lru_prev;
+    } else {
+      this->last = source->lru_prev;
+    }
+    source->lru_prev = source->lru_next = nullptr;
+  }
+
+  // descriptors are also needed for the output, spilled groups and the
+  // like, they are left out of the limit
+  static size_t
+  fd_pool_capacity() {
+    size_t limit = 1024;
+#ifdef _WIN32
+    // the limit of the C runtime for low level descriptors
+    limit = 8192;
+#else
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+      limit = rl.rlim_cur == RLIM_INFINITY ? 65536 : rl.rlim_cur;
+    }
+#endif
+    return limit > 128 ? limit - 64 : std::max<size_t>(limit / 2, 4);
+  }
+
+  FileSource* first = nullptr;
+  FileSource* last = nullptr;
+  size_t count = 0;
+  size_t capacity = 0;
+};
+
+static FdPool fd_pool;
+
+// plain descriptors rather than FILE, closing a FILE walks the list of all
+// open streams, which makes closing files of a large pool slow
+static int
+open_file(const char* path) {
+#ifdef _WIN32
+  return _open(path, _O_RDONLY | _O_BINARY);
+#else
+  return ::open(path, O_RDONLY | O_CLOEXEC);
+#endif
+}
+
+static bool
+seek_file(int fd, uint64_t offset) {
+#ifdef _WIN32
+  return _lseeki64(fd, offset, SEEK_SET) >= 0;
+#else
+  return lseek(fd, offset, SEEK_SET) >= 0;
+#endif
+}
+
+static int64_t
+read_file(int fd, char* buffer, size_t size) {
+  while (1) {
+#ifdef _WIN32
+    int64_t n = _read(fd, buffer, std::min<size_t>(size, 1 << 30));
+#else
+    int64_t n = ::read(fd, buffer, size);
+#endif
+    if (n >= 0 || errno != EINTR) {
+      return n;
+    }
+  }
+}
+
+static void
+close_file(int fd) {
+#ifdef _WIN32
+  _close(fd);
+#else
+  ::close(fd);
+#endif
+}
+
+FileSource::~FileSource() { fd_pool.remove(this); }
+
+std::string_view
+FileSource::head() {
+  if (!this->head_read) {
+    this->head_read = true;
+    if (!this->read_chunk(&this->chunk, &this->chunk_size)) {
+      this->chunk_size = 0;
+    }
+  }
+  return std::string_view(this->chunk, this->chunk_size);
+}
+
+bool
+FileSource::next_chunk(const char** data, size_t* size) {
+  this->head_read = true;
+  if (this->chunk_size > 0) {
+    *data = this->chunk;
+    *size = this->chunk_size;
+    this->chunk_size = 0;
+    return true;
+  }
+  return this->read_chunk(data, size);
+}
+
+size_t
+FileSource::read(char* buffer, size_t size) {
+  this->head_read = true;
+  size_t copied = 0;
+  while (copied < size) {
+    if (this->chunk_size == 0) {
+      // do not wait for the next chunk once some bytes are copied
+      if (copied > 0 || !this->read_chunk(&this->chunk, &this->chunk_size)) {
+        break;
+      }
+      continue;
+    }
+    size_t n = std::min(size - copied, this->chunk_size);
+    memcpy(buffer + copied, this->chunk, n);
+    this->chunk += n;
+    this->chunk_size -= n;
+    copied += n;
+  }
+  return copied;
+}
+
+void
+FileSource::set_pooled(bool pooled) {
+  this->use_pool = pooled;
+  if (pooled) {
+    this->touch();
+  } else {
+    fd_pool.remove(this);
+  }
+}
+
+void
+FileSource::touch() {
+  if (this->use_pool) {
+    fd_pool.touch(this);
+  }
+}
+
+void
+FileSource::finish() {
+  fd_pool.remove(this);
+  this->release();
+}
+
+SyncFileSource::~SyncFileSource() { this->release(); }
+
+bool
+SyncFileSource::open(const std::string& path) {
+  this->path = path;
+  return this->reopen();
+}
+
+bool
+SyncFileSource::reopen() {
+  this->fd = open_file(this->path.c_str());
+  if (this->fd < 0) {
+    return false;
+  }
+  if (this->offset > 0 && !seek_file(this->fd, this->offset)) {
+    this->release();
+    return false;
+  }
+  this->touch();
+  return true;
+}
+
+void
+SyncFileSource::ensure_open() {
+  if (this->fd >= 0) {
+    this->touch();
+    return;
+  }
+  if (!this->reopen()) {
+    fprintf(stderr, "Failed to reopen file %s, message: %s\n",
+            this->path.c_str(), strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+void
+SyncFileSource::release() {
+  if (this->fd >= 0) {
+    close_file(this->fd);
+    this->fd = -1;
+  }
+}
+
+size_t
+SyncFileSource::read_file(char* buffer, size_t size) {
+  this->ensure_open();
+  StageScope scope(StageRead);
+  auto n = filterx::read_file(this->fd, buffer, size);
+  if (n < 0) {
+    fprintf(stderr, "Failed to read file %s, message: %s\n",
+            this->path.c_str(), strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  this->offset += n;
+  if (n == 0) {
+    this->finish();
+  }
+  return n;
+}
+
+bool
+SyncFileSource::read_chunk(const char** data, size_t* size) {
+  size_t want = this->buffer.empty() ? FILE_HEAD_SIZE : FILE_CHUNK_SIZE;
+  if (this->buffer.size() < want) {
+    this->buffer.resize(want);
+    this->memory.update(this->buffer.size());
+  }
+  size_t n = this->read_file(this->buffer.data(), want);
+  *data = this->buffer.data();
+  *size = n;
+  return n > 0;
+}
+
+size_t
+SyncFileSource::read(char* buffer, size_t size) {
+  if (this->chunk_size > 0) {
+    size_t n = FileSource::read(buffer, size);
+    if (this->chunk_size == 0) {
+      // the head is handed out, later reads go to the buffer of the caller
+      this->buffer = std::vector<char>();
+      this->memory.update(0);
+    }
+    return n;
+  }
+  return this->read_file(buffer, size);
+}
+
+#ifdef FILTERX_URING
+
+// reads submitted to the ring at most, more reads wait in a queue, so the
+// number of outstanding reads does not grow with the number of files
+static const unsigned URING_DEPTH = 64;
+
+struct UringRequest {
+  int fd = -1;
+  char* buffer = nullptr;
+  size_t size = 0;
+  uint64_t offset = 0;
+  struct iovec iov;
+  int result = 0;
+  bool queued = false;
+  bool done = true;
+};
+
+// one ring shared by all files, set up with the raw system calls so no
+// library is needed
+class IoRing {
+public:
+  bool
+  setup() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    this->fd = syscall(__NR_io_uring_setup, URING_DEPTH, &params);
+    if (this->fd < 0) {
+      return false;
+    }
+    this->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->cq_size = params.cq_off.cqes
+                    + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      this->sq_size = this->cq_size = std::max(this->sq_size, this->cq_size);
+    }
+    this->sq_ring = mmap(nullptr, this->sq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, this->fd,
+                         IORING_OFF_SQ_RING);
+    if (this->sq_ring == MAP_FAILED) {
+      this->sq_ring = nullptr;
+      return false;
+    }
+    if (single_mmap) {
+      this->cq_ring = this->sq_ring;
+    } else {
+      this->cq_ring = mmap(nullptr, this->cq_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, this->fd,
+                           IORING_OFF_CQ_RING);
+      if (this->cq_ring == MAP_FAILED) {
+        this->cq_ring = nullptr;
+        return false;
+      }
+    }
+    this->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, this->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+    this->sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(this->sq_ring);
+    this->sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    this->sq_mask
+        = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    this->sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(this->cq_ring);
+    this->cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    this->cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    this->cq_mask
+        = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    this->cqes
+        = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    this->depth = std::min(URING_DEPTH, params.sq_entries);
+    return true;
+  }
+
+  ~IoRing() {
+    if (this->sqes) {
+      munmap(this->sqes, this->sqes_size);
+    }
+    if (this->cq_ring && this->cq_ring != this->sq_ring) {
+      munmap(this->cq_ring, this->cq_size);
+    }
+    if (this->sq_ring) {
+      munmap(this->sq_ring, this->sq_size);
+    }
+    if (this->fd >= 0) {
+      ::close(this->fd);
+    }
+  }
+
+  void
+  submit(UringRequest* request) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    request->done = false;
+    request->result = 0;
+    if (this->inflight < this->depth) {
+      this->push(request);
+      this->enter(0);
+    } else {
+      request->queued = true;
+      this->pending.push_back(request);
+    }
+  }
+
+  // waits until the read is done, then its result is the number of bytes
+  // read
+  void
+  wait(UringRequest* request) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    while (1) {
+      this->reap();
+      if (request->done) {
+        return;
+      }
+      this->enter(1);
+    }
+  }
+
+  // the buffer of the request can be freed after this. true if the read
+  // was still queued and is dropped, false if it is done
+  bool
+  cancel(UringRequest* request) {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (request->queued) {
+        auto it = std::find(this->pending.begin(), this->pending.end(),
+                            request);
+        this->pending.erase(it);
+        request->queued = false;
+        request->done = true;
+        return true;
+      }
+    }
+    this->wait(request);
+    return false;
+  }
+
+private:
+  void
+  push(UringRequest* request) {
+    unsigned tail = *this->sq_tail;
+    unsigned index = tail & this->sq_mask;
+    struct io_uring_sqe* sqe = &this->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    request->iov.iov_base = request->buffer;
+    request->iov.iov_len = request->size;
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = request->fd;
+    sqe->off = request->offset;
+    sqe->addr = reinterpret_cast<uint64_t>(&request->iov);
+    sqe->len = 1;
+    sqe->user_data = reinterpret_cast<uint64_t>(request);
+    this->sq_array[index] = index;
+    __atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    this->inflight++;
+    this->unsubmitted++;
+  }
+
+  void
+  enter(unsigned min_complete) {
+    unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (1) {
+      int ret = syscall(__NR_io_uring_enter, this->fd, this->unsubmitted,
+                        min_complete, flags, nullptr, 0);
+      if (ret >= 0) {
+        this->unsubmitted -= std::min<unsigned>(ret, this->unsubmitted);
+        if (this->unsubmitted == 0 || min_complete > 0) {
+          return;
+        }
+        continue;
+      }
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+        if (min_complete > 0 && errno == EBUSY) {
+          return;
+        }
+        continue;
+      }
+      fprintf(stderr, "io_uring_enter failed: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  void
+  reap() {
+    unsigned head = *this->cq_head;
+    unsigned tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      struct io_uring_cqe* cqe = &this->cqes[head & this->cq_mask];
+      auto request = reinterpret_cast<UringRequest*>(cqe->user_data);
+      request->result = cqe->res;
+      request->done = true;
+      this->inflight--;
+      head++;
+    }
+    __atomic_store_n(this->cq_head, head, __ATOMIC_RELEASE);
+    bool submitted = false;
+    while (this->inflight < this->depth && !this->pending.empty()) {
+      auto request = this->pending.front();
+      this->pending.pop_front();
+      request->queued = false;
+      this->push(request);
+      submitted = true;
+    }
+    if (submitted) {
+      this->enter(0);
+    }
+  }
+
+  int fd = -1;
+  void* sq_ring = nullptr;
+  void* cq_ring = nullptr;
+  struct io_uring_sqe* sqes = nullptr;
+  size_t sq_size = 0;
+  size_t cq_size = 0;
+  size_t sqes_size = 0;
+  unsigned* sq_tail = nullptr;
+  unsigned* sq_array = nullptr;
+  unsigned sq_mask = 0;
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned cq_mask = 0;
+  struct io_uring_cqe* cqes = nullptr;
+  unsigned depth = 0;
+  unsigned inflight = 0;
+  unsigned unsubmitted = 0;
+  std::deque<UringRequest*> pending;
+  std::mutex mutex;
+};
+
+static IoRing* io_ring = nullptr;
+
+// two buffers per file, the next read is in flight while the lines of the
+// other buffer are splited
+class UringFileSource : public FileSource {
+public:
+  ~UringFileSource() override { this->release(); }
+
+  bool
+  open(const std::string& path) {
+    this->path = path;
+    this->fd = open_file(path.c_str());
+    if (this->fd < 0) {
+      return false;
+    }
+    this->touch();
+    this->buffer.resize(2 * FILE_CHUNK_SIZE);
+    this->memory.update(this->buffer.size());
+    for (int i = 0; i < 2; i++) {
+      this->requests[i].buffer = this->buffer.data() + i * FILE_CHUNK_SIZE;
+      this->requests[i].size = FILE_CHUNK_SIZE;
+    }
+    this->submit(0, 0);
+    return true;
+  }
+
+  // reads in flight are waited for, their data is kept
+  void
+  release() override {
+    for (int i = 0; i < 2; i++) {
+      if (this->issued[i] && io_ring->cancel(&this->requests[i])) {
+        this->issued[i] = false;
+      }
+    }
+    if (this->fd >= 0) {
+      close_file(this->fd);
+      this->fd = -1;
+    }
+  }
+
+protected:
+  bool
+  read_chunk(const char** data, size_t* size) override {
+    if (this->eof) {
+      return false;
+    }
+    auto request = &this->requests[this->current];
+    if (!this->issued[this->current]) {
+      this->submit(this->current, this->offset);
+    }
+    StageScope scope(StageRead);
+    while (1) {
+      io_ring->wait(request);
+      if (request->result >= 0) {
+        break;
+      }
+      if (request->result != -EINTR && request->result != -EAGAIN) {
+        fprintf(stderr, "Failed to read file %s, message: %s\n",
+                this->path.c_str(), strerror(-request->result));
+        exit(EXIT_FAILURE);
+      }
+      this->submit(this->current, request->offset);
+    }
+    this->issued[this->current] = false;
+    if (request->result == 0) {
+      this->eof = true;
+      this->finish();
+      return false;
+    }
+    this->offset = request->offset + request->result;
+    // the buffer handed out before is free now, read ahead into it
+    int other = 1 - this->current;
+    this->submit(other, this->offset);
+    *data = request->buffer;
+    *size = request->result;
+    this->current = other;
+    return true;
+  }
+
+private:
+  void
+  submit(int i, uint64_t offset) {
+    if (this->fd < 0) {
+      this->fd = open_file(this->path.c_str());
+      if (this->fd < 0) {
+        fprintf(stderr, "Failed to reopen file %s, message: %s\n",
+                this->path.c_str(), strerror(errno));
+        exit(EXIT_FAILURE);
+      }
+    }
+    this->touch();
+    this->requests[i].fd = this->fd;
+    this->requests[i].offset = offset;
+    this->issued[i] = true;
+    io_ring->submit(&this->requests[i]);
+  }
+
+  int fd = -1;
+  std::vector<char> buffer;
+  UringRequest requests[2];
+  bool issued[2] = { false, false };
+  int current = 0;
+  bool eof = false;
+  MemoryAccount memory{ MemoryDataProvider };
+};
+
+#endif
+
+void
+set_io_mode(IoMode mode) {
+  if (mode != IoModeUring) {
+    return;
+  }
+#ifdef FILTERX_URING
+  if (io_ring != nullptr) {
+    return;
+  }
+  io_ring = new IoRing();
+  if (!io_ring->setup()) {
+    auto error = errno;
+    fprintf(stderr, "io_uring is not available (%s), files are read "
+                    "synchronously\n",
+            strerror(error));
+    delete io_ring;
+    io_ring = nullptr;
+  }
+#else
+  fprintf(stderr, "io_uring is not supported on this platform, files are "
+                  "read synchronously\n");
+#endif
+}
+
+FileSource*
+open_file_source(const std::string& path, bool pooled) {
+#ifdef FILTERX_URING
+  if (io_ring != nullptr) {
+    auto source = new UringFileSource();
+    source->set_pooled(pooled);
+    if (!source->open(path)) {
+      delete source;
+      return nullptr;
+    }
+    return source;
+  }
+#endif
+  auto source = new SyncFileSource();
+  source->set_pooled(pooled);
+  if (!source->open(path)) {
+    delete source;
+    return nullptr;
+  }
+  return source;
+}
+
+uint64_t
+file_size(const std::string& path) {
+#ifdef _WIN32
+  struct _stat64 st;
+  if (_stat64(path.c_str(), &st) != 0) {
+    return 0;
+  }
+#else
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return 0;
+  }
+#endif
+  return st.st_size;
+}
+
+} // namespace filterx
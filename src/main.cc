@@ -1,17 +1,52 @@
+#include "cache.h"
 #include "process.h"
 
 int
 main(int argc, char** argv) {
+  // an input file named cache is still read unless build follows it
+  if (argc > 2 && strcmp(argv[1], "cache") == 0
+      && strcmp(argv[2], "build") == 0) {
+    return filterx::cache_main(argc - 1, argv + 1);
+  }
   filterx::GroupParamsList group_params;
   filterx::FileParamsList file_params;
   filterx::ProcessorParams process_params = filterx::defaultProcessorParams;
   filterx::parse(argc, argv, &group_params, &file_params, &process_params);
+  filterx::memory_governor.set_budget(process_params.max_memory);
+  filterx::symbol_table.set_enabled(process_params.intern);
+  filterx::set_io_mode(process_params.io_mode);
+  if (!process_params.contigs_path.empty()) {
+    filterx::contig_order.load(process_params.contigs_path);
+  }
+  if (process_params.counters
+      && process_params.stats == filterx::StatsFormatNone) {
+    process_params.stats = filterx::StatsFormatText;
+  }
+  if (process_params.stats != filterx::StatsFormatNone) {
+    filterx::stats.enable(process_params.stats, process_params.counters);
+  }
+  if (!process_params.trace_path.empty()) {
+    filterx::tracer.enable(process_params.trace_path);
+    filterx::tracer.name_thread("merge");
+  }
   filterx::Processor processor(process_params);
-  for (auto file_param : file_params) {
+  if (!file_params.empty()) {
+    processor.select_kernel(&file_params.front());
+  }
+  for (auto& file_param : file_params) {
     auto record = filterx::create_record_from_file_param(&file_param);
     processor.add_record(record);
   }
+  filterx::progress.start(process_params.progress);
   processor.prepare();
   processor.process();
+  filterx::progress.stop();
+  filterx::tracer.write();
+  if (filterx::stats.on()) {
+    processor.report_stats(stderr);
+  }
+  if (process_params.max_memory > 0) {
+    filterx::memory_governor.report(stderr);
+  }
   return 0;
 }
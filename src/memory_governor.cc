@@ -0,0 +1,28 @@
+#include "memory_governor.h"
+
+namespace filterx {
+
+MemoryGovernor memory_governor;
+
+static const char* MEMORY_SUBSYSTEM_NAMES[MemorySubsystemCount] = {
+  "row_buffer",
+  "data_provider",
+  "output",
+  "symbol_table",
+};
+
+void
+MemoryGovernor::report(FILE* file) {
+  fprintf(file, "peak memory usage:\n");
+  for (int i = 0; i < MemorySubsystemCount; i++) {
+    fprintf(file, "  %-14s %10.2f MB\n", MEMORY_SUBSYSTEM_NAMES[i],
+            this->peak[i].load() / 1048576.0);
+  }
+  fprintf(file, "  %-14s %10.2f MB\n", "total",
+          this->peak_total.load() / 1048576.0);
+  if (this->budget > 0) {
+    fprintf(file, "  %-14s %10.2f MB\n", "budget", this->budget / 1048576.0);
+  }
+}
+
+} // namespace filterx
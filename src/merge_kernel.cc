@@ -0,0 +1,76 @@
+#include "merge_kernel.h"
+
+namespace filterx {
+
+template <RowKeyType Type>
+static MergeKernel*
+create_single_key_kernel(std::vector<uint32_t>& columns,
+                         RowKeySortOrder order) {
+  if (order == RowKeySortOrderAsc) {
+    return new ShapeKernel<KeyColumn<Type, RowKeySortOrderAsc> >(columns);
+  }
+  return new ShapeKernel<KeyColumn<Type, RowKeySortOrderDesc> >(columns);
+}
+
+template <RowKeyType FirstType, RowKeySortOrder FirstOrder>
+static MergeKernel*
+create_pair_kernel(std::vector<uint32_t>& columns, RowKeySortOrder order) {
+  typedef KeyColumn<FirstType, FirstOrder> First;
+  if (order == RowKeySortOrderAsc) {
+    return new ShapeKernel<First,
+                           KeyColumn<RowKeyTypeInt, RowKeySortOrderAsc> >(
+        columns);
+  }
+  return new ShapeKernel<First,
+                         KeyColumn<RowKeyTypeInt, RowKeySortOrderDesc> >(
+      columns);
+}
+
+MergeKernel*
+create_merge_kernel(std::vector<uint32_t>& columns,
+                    std::vector<RowKeyType>& key_types,
+                    std::vector<RowKeySortOrder>& sort_order) {
+  for (size_t i = 0; i < key_types.size(); i++) {
+    // interned strings and floats are compared by TypedKey only
+    if ((key_types[i] == RowKeyTypeString && symbol_table.is_enabled())
+        || key_types[i] == RowKeyTypeFloat
+        || (sort_order[i] != RowKeySortOrderAsc
+            && sort_order[i] != RowKeySortOrderDesc)) {
+      return nullptr;
+    }
+  }
+  if (columns.size() == 1) {
+    if (key_types[0] == RowKeyTypeString) {
+      return create_single_key_kernel<RowKeyTypeString>(columns,
+                                                        sort_order[0]);
+    }
+    if (key_types[0] == RowKeyTypeInt) {
+      return create_single_key_kernel<RowKeyTypeInt>(columns, sort_order[0]);
+    }
+    if (key_types[0] == RowKeyTypeContig) {
+      return create_single_key_kernel<RowKeyTypeContig>(columns,
+                                                        sort_order[0]);
+    }
+  }
+  if (columns.size() == 2 && key_types[0] == RowKeyTypeString
+      && key_types[1] == RowKeyTypeInt) {
+    if (sort_order[0] == RowKeySortOrderAsc) {
+      return create_pair_kernel<RowKeyTypeString, RowKeySortOrderAsc>(
+          columns, sort_order[1]);
+    }
+    return create_pair_kernel<RowKeyTypeString, RowKeySortOrderDesc>(
+        columns, sort_order[1]);
+  }
+  if (columns.size() == 2 && key_types[0] == RowKeyTypeContig
+      && key_types[1] == RowKeyTypeInt) {
+    if (sort_order[0] == RowKeySortOrderAsc) {
+      return create_pair_kernel<RowKeyTypeContig, RowKeySortOrderAsc>(
+          columns, sort_order[1]);
+    }
+    return create_pair_kernel<RowKeyTypeContig, RowKeySortOrderDesc>(
+        columns, sort_order[1]);
+  }
+  return nullptr;
+}
+
+} // namespace filterx
@@ -0,0 +1,256 @@
+#include "output_pipeline.h"
+
+namespace filterx {
+
+static const size_t OUTPUT_FLUSH_SIZE = 1 << 20;
+static const size_t GROUPS_PER_BATCH = 256;
+// once the memory budget is reached, output is written in smaller pieces
+static const size_t PRESSURE_FLUSH_SIZE = 64 << 10;
+static const size_t PRESSURE_GROUPS_PER_BATCH = 16;
+static const size_t BATCHES_PER_THREAD = 4;
+
+OutputPipeline::OutputPipeline(FILE* output_file, int nthreads,
+                               GroupFormatter formatter)
+    : output_file(output_file), formatter(formatter), nthreads(nthreads) {
+  // the single thread buffer grows with the output, nothing is reserved so a
+  // small memory budget is not spent on it up front
+  if (this->nthreads <= 1) {
+    return;
+  }
+  size_t nbatches = this->nthreads * BATCHES_PER_THREAD;
+  for (size_t i = 0; i < nbatches; i++) {
+    auto batch = new OutputBatch();
+    batch->groups.resize(GROUPS_PER_BATCH);
+    this->all_batches.push_back(batch);
+    this->free_batches.push_back(batch);
+  }
+  for (int i = 0; i < this->nthreads; i++) {
+    this->workers.emplace_back(&OutputPipeline::worker, this);
+  }
+}
+
+OutputPipeline::~OutputPipeline() {
+  this->finish();
+  for (auto batch : this->all_batches) {
+    delete batch;
+  }
+}
+
+OutputGroup*
+OutputPipeline::next_group(size_t nslots) {
+  OutputGroup* group = nullptr;
+  if (this->nthreads <= 1) {
+    group = &this->group;
+  } else {
+    if (this->current == nullptr) {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      if (this->free_batches.empty()) {
+        // every batch is formatted or written, the merge waits for output
+        TraceSpan span("wait batch", "wait");
+        this->free_cv.wait(lock,
+                           [this] { return !this->free_batches.empty(); });
+      }
+      this->current = this->free_batches.back();
+      this->free_batches.pop_back();
+      this->current->ngroups = 0;
+      this->current->memory = 0;
+      this->current->formatted = false;
+      this->current->text.clear();
+    }
+    group = &this->current->groups[this->current->ngroups];
+  }
+  if (group->slots.size() != nslots) {
+    group->slots.resize(nslots);
+  }
+  for (auto& slot : group->slots) {
+    slot.present = false;
+    slot.nrows = 0;
+  }
+  group->memory = 0;
+  return group;
+}
+
+void
+OutputPipeline::commit_group(bool spilled) {
+  if (this->nthreads <= 1) {
+    memory_governor.add(MemoryOutput, this->group.memory);
+    {
+      StageScope scope(StageFormat);
+      this->formatter(&this->group, &this->buffer);
+    }
+    memory_governor.add(MemoryOutput, -this->group.memory);
+    this->flush_if_full(&this->buffer);
+    return;
+  }
+  if (spilled) {
+    // the group is not counted in the batch, write everything before it
+    // first, then format it here
+    auto group = &this->current->groups[this->current->ngroups];
+    if (this->current->ngroups > 0) {
+      this->submit_current_batch();
+    }
+    this->wait_committed();
+    {
+      StageScope scope(StageFormat);
+      this->formatter(group, &this->buffer);
+    }
+    this->write_text(&this->buffer);
+    if (this->current != nullptr) {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->free_batches.push_back(this->current);
+      this->current = nullptr;
+    }
+    return;
+  }
+  this->current->memory
+      += this->current->groups[this->current->ngroups].memory;
+  this->current->ngroups++;
+  if (this->current->ngroups == this->current->groups.size()
+      || (this->current->ngroups >= PRESSURE_GROUPS_PER_BATCH
+          && memory_governor.over_budget())) {
+    this->submit_current_batch();
+  }
+}
+
+void
+OutputPipeline::submit_current_batch() {
+  if (this->current == nullptr) {
+    return;
+  }
+  memory_governor.add(MemoryOutput, this->current->memory);
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->current->seq = this->next_seq++;
+  this->work_queue.push_back(this->current);
+  this->commit_queue.push_back(this->current);
+  this->current = nullptr;
+  this->work_cv.notify_one();
+}
+
+void
+OutputPipeline::worker() {
+  tracer.name_thread("format");
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while (1) {
+    this->work_cv.wait(lock, [this] {
+      return this->stop || !this->work_queue.empty();
+    });
+    if (this->work_queue.empty()) {
+      return;
+    }
+    auto batch = this->work_queue.front();
+    this->work_queue.pop_front();
+    lock.unlock();
+    {
+      StageScope scope(StageFormat);
+      TraceSpan span("format", "output");
+      span.set_arg("groups", batch->ngroups);
+      for (size_t i = 0; i < batch->ngroups; i++) {
+        this->formatter(&batch->groups[i], &batch->text);
+      }
+    }
+    batch->memory += batch->text.capacity();
+    memory_governor.add(MemoryOutput, batch->text.capacity());
+    lock.lock();
+    batch->formatted = true;
+    this->write_ready_batches(lock);
+  }
+}
+
+// only one thread writes at a time, it keeps writing while the oldest
+// submitted batch is formatted, so the output keeps the key order
+void
+OutputPipeline::write_ready_batches(std::unique_lock<std::mutex>& lock) {
+  if (this->writer_active) {
+    return;
+  }
+  this->writer_active = true;
+  while (!this->commit_queue.empty() && this->commit_queue.front()->formatted) {
+    auto batch = this->commit_queue.front();
+    this->commit_queue.pop_front();
+    lock.unlock();
+    this->write_text(&batch->text);
+    memory_governor.add(MemoryOutput, -batch->memory);
+    lock.lock();
+    this->free_batches.push_back(batch);
+    this->free_cv.notify_one();
+  }
+  this->writer_active = false;
+  if (this->commit_queue.empty()) {
+    this->done_cv.notify_all();
+  }
+}
+
+void
+OutputPipeline::flush_if_full(std::string* output_buffer) {
+  if (output_buffer != &this->buffer) {
+    return;
+  }
+  bool pressure = memory_governor.over_budget();
+  if (output_buffer->size() >= OUTPUT_FLUSH_SIZE
+      || (output_buffer->size() >= PRESSURE_FLUSH_SIZE && pressure)) {
+    this->write_text(output_buffer);
+    // under pressure the memory of a large buffer is given back
+    if (pressure && output_buffer->capacity() > PRESSURE_FLUSH_SIZE) {
+      std::string().swap(*output_buffer);
+    }
+  }
+  this->buffer_memory.update(output_buffer->capacity());
+}
+
+std::string*
+OutputPipeline::direct_buffer() {
+  return &this->buffer;
+}
+
+void
+OutputPipeline::wait_committed() {
+  TraceSpan span("wait output", "wait");
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->done_cv.wait(lock, [this] { return this->commit_queue.empty(); });
+}
+
+void
+OutputPipeline::write_text(std::string* text) {
+  if (text->empty()) {
+    return;
+  }
+  StageScope scope(StageWrite);
+  TraceSpan span("write", "output");
+  span.set_arg("bytes", text->size());
+  if (stats.on()) {
+    stats.add_output(text->size());
+  }
+  fwrite(text->data(), 1, text->size(), this->output_file);
+  text->clear();
+}
+
+void
+OutputPipeline::finish() {
+  if (this->finished) {
+    return;
+  }
+  this->finished = true;
+  if (this->nthreads <= 1) {
+    this->write_text(&this->buffer);
+    return;
+  }
+  if (this->current != nullptr && this->current->ngroups > 0) {
+    this->submit_current_batch();
+  }
+  this->wait_committed();
+  this->write_text(&this->buffer);
+  std::unique_lock<std::mutex> lock(this->mutex);
+  if (this->current != nullptr) {
+    this->free_batches.push_back(this->current);
+    this->current = nullptr;
+  }
+  this->stop = true;
+  this->work_cv.notify_all();
+  lock.unlock();
+  for (auto& worker : this->workers) {
+    worker.join();
+  }
+  this->workers.clear();
+}
+
+} // namespace filterx
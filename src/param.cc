@@ -1,5 +1,8 @@
 #include "param.h"
 
+#include <fstream>
+#include <unordered_map>
+
 namespace filterx {
 
 static GroupParams defaultGroupParams = {
@@ -14,6 +17,7 @@ static GroupParams defaultGroupParams = {
   .max_count = INT32_MAX,
   .comment = '#',
   .placehoder = '-',
+  .rank = { -1, 0, RowKeyTypeUnknown, RowKeySortOrderUnknown },
 };
 
 static FileParams defaultFileParams = {
@@ -29,6 +33,7 @@ static FileParams defaultFileParams = {
   .max_count = INT32_MAX,
   .comment = '#',
   .placehoder = '-',
+  .rank = { -1, 0, RowKeyTypeUnknown, RowKeySortOrderUnknown },
 };
 
 ProcessorParams defaultProcessorParams = {
@@ -41,6 +46,19 @@ ProcessorParams defaultProcessorParams = {
   .output_separator = '\t',
   .row_mode = false,
   .full_mode = false,
+  .threads = 1,
+  .spill_size = 256 << 20,
+  .max_memory = 0,
+  .aggregates = {},
+  .bitmap = BitmapFormatNone,
+  .intern = false,
+  .kernel = MergeKernelAuto,
+  .io_mode = IoModeSync,
+  .stats = StatsFormatNone,
+  .counters = false,
+  .progress = 0,
+  .trace_path = std::string(),
+  .contigs_path = std::string(),
 };
 
 Record*
@@ -48,11 +66,22 @@ create_record_from_file_param(FileParams* params) {
   auto record = new Record(params->path, params->separator, params->row_keys,
                            params->key_types, params->sort_order);
   record->cut_columns = params->cut_columns;
+  record->set_vcf_fields(params->row_keys, params->cut_columns);
+  for (auto column : params->row_keys) {
+    record->read_column(column);
+  }
+  for (auto column : params->cut_columns) {
+    record->read_column(column);
+  }
+  if (params->rank.top > 0) {
+    record->read_column(params->rank.column);
+  }
   record->must_exist = params->must_exist;
   record->set_record_limit(params->record_limit);
   record->set_count(params->min_count, params->max_count);
   record->comment = params->comment;
   record->placehoder = params->placehoder;
+  record->buffer()->set_rank(params->rank);
   return record;
 }
 
@@ -104,6 +133,16 @@ apply_group_to_file(FileParams* file_params, GroupParams* group_params) {
       && file_params->placehoder == defaultFileParams.placehoder) {
     file_params->placehoder = group_params->placehoder;
   }
+  if (group_params->rank.top != defaultFileParams.rank.top
+      && file_params->rank.top == defaultFileParams.rank.top) {
+    file_params->rank.top = group_params->rank.top;
+  }
+  if (group_params->rank.type != defaultFileParams.rank.type
+      && file_params->rank.type == defaultFileParams.rank.type) {
+    file_params->rank.column = group_params->rank.column;
+    file_params->rank.type = group_params->rank.type;
+    file_params->rank.order = group_params->rank.order;
+  }
 }
 
 static const char ARG_SEPARATOR = ':';
@@ -121,6 +160,7 @@ typedef struct {
   std::vector<RowKeySortOrder> sort_order;
   std::vector<int> cut_columns;
   std::vector<int> group_numbers;
+  RowRank rank;
 } ParseAges;
 
 static ParseAges defaultParseAges = {
@@ -136,6 +176,7 @@ static ParseAges defaultParseAges = {
   .sort_order = {},
   .cut_columns = { -1 },
   .group_numbers = {},
+  .rank = { -1, 0, RowKeyTypeUnknown, RowKeySortOrderUnknown },
 };
 
 static char SPERAATOR[] = {
@@ -156,6 +197,97 @@ query_separator(const char* arg) {
   return arg[0];
 }
 
+// parse a size like 1024, 64K, 256M or 2G
+static inline bool
+parse_size(const char* arg, size_t* size) {
+  char* end = nullptr;
+  errno = 0;
+  auto value = strtoull(arg, &end, 10);
+  if (end == arg || errno != 0) {
+    return false;
+  }
+  switch (*end) {
+  case '\0':
+    break;
+  case 'k':
+  case 'K':
+    value <<= 10;
+    end++;
+    break;
+  case 'm':
+  case 'M':
+    value <<= 20;
+    end++;
+    break;
+  case 'g':
+  case 'G':
+    value <<= 30;
+    end++;
+    break;
+  default:
+    return false;
+  }
+  if (*end != '\0') {
+    return false;
+  }
+  *size = value;
+  return true;
+}
+
+// parse aggregates like count,sum:5,min:5,max:12
+static inline bool
+parse_aggregates(const char* arg, std::vector<AggregateSpec>* aggregates,
+                 std::string* error) {
+  std::string_view value(arg);
+  size_t pos = 0;
+  while (pos < value.size()) {
+    size_t end = value.find(',', pos);
+    if (end == std::string_view::npos) {
+      end = value.size();
+    }
+    auto item = value.substr(pos, end - pos);
+    pos = end + 1;
+    if (item.empty()) {
+      continue;
+    }
+    AggregateSpec spec = { AggregateTypeCount, -1 };
+    auto colon = item.find(':');
+    auto name = item.substr(0, colon);
+    if (name == "count") {
+      aggregates->push_back(spec);
+      continue;
+    }
+    if (name == "sum") {
+      spec.type = AggregateTypeSum;
+    } else if (name == "min") {
+      spec.type = AggregateTypeMin;
+    } else if (name == "max") {
+      spec.type = AggregateTypeMax;
+    } else {
+      *error = "unknown aggregate " + std::string(name)
+               + ", expect count, sum, min or max";
+      return false;
+    }
+    if (colon == std::string_view::npos || colon + 1 == item.size()) {
+      *error = "aggregate " + std::string(name) + " needs a column, like "
+               + std::string(name) + ":5";
+      return false;
+    }
+    int column = atoi(std::string(item.substr(colon + 1)).c_str());
+    if (column <= 0) {
+      *error = "aggregate column number starts from 1";
+      return false;
+    }
+    spec.column = column - 1;
+    aggregates->push_back(spec);
+  }
+  if (aggregates->empty()) {
+    *error = "aggregate is empty";
+    return false;
+  }
+  return true;
+}
+
 // 添加一个trim函数用于去除字符串两端的空格
 static inline std::string_view
 trim(std::string_view sv) {
@@ -226,7 +358,17 @@ parse_args(ParseAges* A, const char* arg, std::string* error) {
             pos++;
           }
           std::string_view cut = value.substr(start, pos - start);
-          if (cut.find('-') == std::string::npos) {
+          if (!cut.empty() && (cut[0] < '0' || cut[0] > '9')) {
+            // a VCF column, like INFO/DP or {FORMAT/GT@NA12878}
+            if (cut.size() > 2 && cut.front() == '{' && cut.back() == '}') {
+              cut = cut.substr(1, cut.size() - 2);
+            }
+            int c = vcf_fields.column(cut, error);
+            if (c < 0) {
+              return false;
+            }
+            A->cut_columns.push_back(c);
+          } else if (cut.find('-') == std::string::npos) {
             auto c = std::stoi(std::string(cut));
             if (c == 0) {
               *error = "cut column number starts from 1, but got 0";
@@ -287,6 +429,73 @@ parse_args(ParseAges* A, const char* arg, std::string* error) {
       continue;
     }
 
+    // parse top=3 and by=12F
+    if (attr.size() > 4 && attr.substr(0, 3) == "top") {
+      auto eq_pos = attr.find('=');
+      if (eq_pos == std::string_view::npos) {
+        *error = "top is invalid, expect top=<number>";
+        return false;
+      }
+      A->rank.top = std::stoi(std::string(trim(attr.substr(eq_pos + 1))));
+      if (A->rank.top < 1) {
+        *error = "top should be greater than 0";
+        return false;
+      }
+      idx++;
+      continue;
+    }
+    if (attr.size() > 3 && attr.substr(0, 2) == "by") {
+      auto eq_pos = attr.find('=');
+      if (eq_pos == std::string_view::npos) {
+        *error = "by is invalid, expect by=<column><type>, e.g. by=12F";
+        return false;
+      }
+      std::string_view value = trim(attr.substr(eq_pos + 1));
+      size_t pos = 0;
+      while (pos < value.size() && value[pos] >= '0' && value[pos] <= '9') {
+        pos++;
+      }
+      if (pos == 0 || pos + 1 != value.size()) {
+        *error = "by is invalid, expect by=<column><type>, e.g. by=12F";
+        return false;
+      }
+      int column = std::stoi(std::string(value.substr(0, pos)));
+      if (column == 0) {
+        *error = "by column number starts from 1, but got 0";
+        return false;
+      }
+      A->rank.column = column - 1;
+      switch (value[pos]) {
+      case 'f':
+      case 'i':
+      case 's':
+        A->rank.order = RowKeySortOrderAsc;
+        break;
+      case 'F':
+      case 'I':
+      case 'S':
+        A->rank.order = RowKeySortOrderDesc;
+        break;
+      default:
+        *error = "by type is unknown";
+        return false;
+      }
+      switch (value[pos]) {
+      case 'f':
+      case 'F':
+        A->rank.type = RowKeyTypeFloat;
+        break;
+      case 'i':
+      case 'I':
+        A->rank.type = RowKeyTypeInt;
+        break;
+      default:
+        A->rank.type = RowKeyTypeString;
+      }
+      idx++;
+      continue;
+    }
+
     // 检查属性是否包含等号
     auto eq_pos = attr.find('=');
     if (eq_pos == std::string::npos) {
@@ -372,8 +581,19 @@ parse_args(ParseAges* A, const char* arg, std::string* error) {
         std::string_view::size_type pos = 0;
         while (pos < value_slice.size()) {
           std::string_view::size_type start = pos;
-          while (pos < value_slice.size() && value_slice[pos] >= '0'
-                 && value_slice[pos] <= '9') {
+          // a VCF column in braces, like {INFO/DP}i
+          std::string_view name;
+          if (value_slice[pos] == '{') {
+            auto close = value_slice.find('}', pos);
+            if (close == std::string_view::npos) {
+              *error = "key column { is not closed";
+              return false;
+            }
+            name = value_slice.substr(pos + 1, close - pos - 1);
+            pos = close + 1;
+          }
+          while (name.empty() && pos < value_slice.size()
+                 && value_slice[pos] >= '0' && value_slice[pos] <= '9') {
             pos++;
           }
           std::string_view col = value_slice.substr(start, pos - start);
@@ -385,7 +605,8 @@ parse_args(ParseAges* A, const char* arg, std::string* error) {
           while (pos < value_slice.size()
                  && (value_slice[pos] == 'f' || value_slice[pos] == 'i'
                      || value_slice[pos] == 's' || value_slice[pos] == 'F'
-                     || value_slice[pos] == 'I' || value_slice[pos] == 'S')) {
+                     || value_slice[pos] == 'I' || value_slice[pos] == 'S'
+                     || value_slice[pos] == 'c' || value_slice[pos] == 'C')) {
             pos++;
           }
           std::string_view type = value_slice.substr(start, pos - start);
@@ -393,7 +614,16 @@ parse_args(ParseAges* A, const char* arg, std::string* error) {
             *error = "key type is empty";
             return false;
           }
-          uint32_t col_number = std::stoi(std::string(col));
+          uint32_t col_number = 0;
+          if (!name.empty()) {
+            int c = vcf_fields.column(name, error);
+            if (c < 0) {
+              return false;
+            }
+            col_number = c + 1;
+          } else {
+            col_number = std::stoi(std::string(col));
+          }
           RowKeyType key_type = RowKeyTypeUnknown;
           RowKeySortOrder sort_order = RowKeySortOrderUnknown;
           switch (type[0]) {
@@ -421,6 +651,14 @@ parse_args(ParseAges* A, const char* arg, std::string* error) {
             key_type = RowKeyTypeString;
             sort_order = RowKeySortOrderDesc;
             break;
+          case 'c':
+            key_type = RowKeyTypeContig;
+            sort_order = RowKeySortOrderAsc;
+            break;
+          case 'C':
+            key_type = RowKeyTypeContig;
+            sort_order = RowKeySortOrderDesc;
+            break;
           default:
             *error = "key type is unknown";
             return false;
@@ -460,9 +698,12 @@ parse_args(ParseAges* A, const char* arg, std::string* error) {
 FileParams
 parse_file_params(const char* arg, GroupParamsList* group_params_list) {
   ParseAges A = defaultParseAges;
-  // parse path
+  // parse path, the patterns of shards are part of it
   size_t len = strlen(arg);
   size_t idx = 0;
+  if (strncmp(arg, SHARDS_PREFIX, sizeof(SHARDS_PREFIX) - 1) == 0) {
+    idx = sizeof(SHARDS_PREFIX) - 1;
+  }
   while (idx < len && arg[idx] != ARG_SEPARATOR) {
     idx++;
   }
@@ -485,6 +726,7 @@ parse_file_params(const char* arg, GroupParamsList* group_params_list) {
   file_params.placehoder = A.placehoder;
   file_params.cut_columns = A.cut_columns;
   file_params.must_exist = A.exist;
+  file_params.rank = A.rank;
   if (A.row_keys.size() > 0) {
     file_params.row_keys = A.row_keys;
     file_params.key_types = A.key_types;
@@ -509,7 +751,7 @@ parse_file_params(const char* arg, GroupParamsList* group_params_list) {
   for (int i = A.group_numbers.size(); i > 0; i--) {
     auto group_number = A.group_numbers[i - 1];
     int found = 0;
-    for (auto group_params : *group_params_list) {
+    for (auto& group_params : *group_params_list) {
       auto group_id = std::get<0>(group_params);
       if (group_id == group_number) {
         apply_group_to_file(&file_params, &std::get<1>(group_params));
@@ -542,6 +784,7 @@ parse_group_params(const char* arg) {
   group_params.placehoder = A.placehoder;
   group_params.cut_columns = A.cut_columns;
   group_params.must_exist = A.exist;
+  group_params.rank = A.rank;
   if (A.row_keys.size() > 0) {
     group_params.row_keys = A.row_keys;
     group_params.key_types = A.key_types;
@@ -552,18 +795,11 @@ parse_group_params(const char* arg) {
 
 void
 check_file_params(FileParamsList* file_params_list) {
-  for (auto file_params : *file_params_list) {
+  for (auto& file_params : *file_params_list) {
     if (file_params.path.empty()) {
       fprintf(stderr, "file path is empty\n");
       exit(EXIT_FAILURE);
     }
-    // check if file exists
-    FILE* file = fopen(file_params.path.data(), "r");
-    if (file == nullptr) {
-      fprintf(stderr, "file %s does not exist\n", file_params.path.data());
-      exit(EXIT_FAILURE);
-    }
-    fclose(file);
     if (file_params.separator == '\0') {
       fprintf(stderr, "file %s separator is empty\n", file_params.path.data());
       exit(EXIT_FAILURE);
@@ -580,6 +816,12 @@ check_file_params(FileParamsList* file_params_list) {
       fprintf(stderr, "file %s sort order is empty\n", file_params.path.data());
       exit(EXIT_FAILURE);
     }
+    if (file_params.rank.top > 0
+        && file_params.rank.type == RowKeyTypeUnknown) {
+      fprintf(stderr, "file %s sets top but no by column\n",
+              file_params.path.data());
+      exit(EXIT_FAILURE);
+    }
   }
   // ensure all file's param keys are the same
   for (int i = 1; i < file_params_list->size(); i++) {
@@ -614,6 +856,17 @@ check_file_params(FileParamsList* file_params_list) {
   }
 }
 
+// the input of `filterx cache build`, it takes no group but must set keys
+FileParams
+parse_cache_file_params(const char* arg) {
+  GroupParamsList group_params_list;
+  group_params_list.push_back(std::make_tuple(1, defaultGroupParams));
+  FileParamsList file_params_list;
+  file_params_list.push_back(parse_file_params(arg, &group_params_list));
+  check_file_params(&file_params_list);
+  return file_params_list[0];
+}
+
 void
 help() {
   fprintf(stderr,
@@ -623,6 +876,8 @@ help() {
                   "Unexpected behaviors on "
                   "unsorted files, except only one file as input\n");
   fprintf(stderr, "Usage: filterx [options] <file_name:attribute> ...\n");
+  fprintf(stderr, "       filterx cache build [-o <output>] "
+                  "<file_name:attribute>\n");
   fprintf(stderr, "Options:\n");
   fprintf(stderr, "  -[1-9]+ <group>   Group filter conditions\n");
 
@@ -637,6 +892,77 @@ help() {
   fprintf(stderr, "  -F                Full mode, output all columns, only "
                   "available in row mode\n");
   fprintf(stderr, "  -o  <file>        Output file, default is stdout\n");
+  fprintf(stderr,
+          "  -t  <threads>     Output formatting threads, default is 1\n");
+  fprintf(stderr, "  --spill-size <size>\n"
+                  "                    Spill rows of a key group to disk once "
+                  "they use more\n"
+                  "                    than <size> memory, 0 disables it, "
+                  "default is 256M\n");
+  fprintf(stderr, "  --max-memory <size>\n"
+                  "                    Memory budget of row buffers, input "
+                  "buffers and output,\n"
+                  "                    use less memory once it is reached and "
+                  "report the peak\n"
+                  "                    usage at exit, default is unlimited\n");
+  fprintf(stderr, "  --agg <count|sum:N|min:N|max:N,...>\n"
+                  "                    Output one line per key with the "
+                  "aggregates of every\n"
+                  "                    file, over column N for sum, min and "
+                  "max. cut, l, -R\n"
+                  "                    and -F are ignored in this mode\n");
+  fprintf(stderr, "  --bitmap <hex|b64>\n"
+                  "                    Output one line per key with a bitset "
+                  "of the files\n"
+                  "                    having it, in hex or base64, can not be "
+                  "used with --agg\n");
+  fprintf(stderr, "  --intern          Intern string keys in a table shared by "
+                  "all files, so\n"
+                  "                    equal keys compare as integers\n");
+  fprintf(stderr, "  --kernel <auto|generic>\n"
+                  "                    Merge with code specialized for the "
+                  "key columns when\n"
+                  "                    there is one (auto), or always with "
+                  "the generic code\n");
+  fprintf(stderr, "  --io <sync|uring>\n"
+                  "                    Read input files with blocking reads "
+                  "(sync), or with\n"
+                  "                    io_uring, keeping the next read of "
+                  "every file in\n"
+                  "                    flight (uring, Linux only), default "
+                  "is sync\n");
+  fprintf(stderr, "  --stats[=text|json]\n"
+                  "                    Report bytes, lines and groups of "
+                  "every file, time of\n"
+                  "                    every stage and output size to "
+                  "stderr at exit\n");
+  fprintf(stderr, "  --counters        Add cycles, instructions, branch "
+                  "misses and cache misses\n"
+                  "                    of every stage to the --stats report, "
+                  "Linux only\n");
+  fprintf(stderr, "  --trace <file>    Write spans of reads, merge, "
+                  "formatting, writes and waits\n"
+                  "                    of every thread to <file> as "
+                  "Chrome trace events\n");
+  fprintf(stderr, "  --contigs <file>  Order of contig keys (c/C), from a "
+                  ".fai, a VCF or SAM\n"
+                  "                    header or one contig per line, "
+                  "default is the ##contig\n"
+                  "                    lines of the inputs\n");
+  fprintf(stderr, "  --progress[=<seconds>]\n"
+                  "                    Report the offset, key and groups of "
+                  "every file and the\n"
+                  "                    overall speed to stderr every "
+                  "<seconds>, default is 10.\n"
+                  "                    A report is also printed on SIGUSR1\n");
+  fprintf(stderr, "  --files-from <file>, @<file>\n"
+                  "                    Read inputs from <file>, one "
+                  "<file_name:attribute> per\n"
+                  "                    line, for more inputs than the "
+                  "command line can hold\n");
+  fprintf(stderr, "  shards:<pattern>[,<pattern>]\n"
+                  "                    Read the matching files as one input, "
+                  "in natural order\n");
   fprintf(stderr, "  -h, --help        Show this help message\n");
 
   fprintf(stderr, "List of attributes:\n");
@@ -646,25 +972,40 @@ help() {
   fprintf(stderr, "  M=<max_count>     Max count, default is 2147483647\n");
   fprintf(stderr, "  l=<record_limit>  Record limit, default is -1\n");
   fprintf(stderr, "  p=<placehoder>    Placehoder, default is -\n");
+  fprintf(stderr, "  top=<number>      Keep the best rows of a record ranked by "
+                  "the by column\n");
+  fprintf(stderr, "  by=<column>       Rank column, e.g. 12F, the type is same "
+                  "as key\n");
   fprintf(
       stderr,
       "  req=[Y|N]        Y: must exist, N: not exist, default is either\n");
   fprintf(stderr, "  k=<key>          Key, e.g. 1f2i3S\n");
   fprintf(
       stderr,
-      "    There are three types of keys: float(f/F), int(i/I), string(s/S)\n");
-  fprintf(stderr,
-          "    f: float, i: int, s: string (ascending) from small to large\n");
-  fprintf(stderr,
-          "    F: float, I: int, S: string (descending) from large to small\n");
+      "    There are four types of keys: float(f/F), int(i/I), string(s/S),\n"
+      "    contig(c/C)\n");
+  fprintf(stderr, "    f: float, i: int, s: string, c: contig (ascending) from "
+                  "small to large\n");
+  fprintf(stderr, "    F: float, I: int, S: string, C: contig (descending) "
+                  "from large to small\n");
+  fprintf(stderr, "    contigs are ordered like the ##contig lines or "
+                  "--contigs, e.g. 1c2i\n");
+  fprintf(stderr, "    VCF columns are named in braces: {CHROM}..{FORMAT}, "
+                  "{INFO/<key>} and\n"
+                  "    {FORMAT/<key>@<sample>}, e.g. {CHROM}c{POS}i{INFO/DP}i\n");
   fprintf(stderr,
           "  cut=<columns>     Columns of outputed, default is key columns\n");
+  fprintf(stderr, "    VCF columns can be named like keys, e.g. "
+                  "cut=1,2,INFO/DP,FORMAT/GT@A\n");
+  fprintf(stderr, "    BCF files are read as VCF, only the used columns are "
+                  "decoded\n");
   fprintf(
       stderr,
       "  <group>           Group number, default apply group 1 to all files\n");
   fprintf(stderr, "Examples:\n");
   fprintf(stderr, "  filterx -1 \"k=1s:cut=1,3-5\" -2 \"m=2:l=1\" "
                   "file1:2:cut=3 file2:req=Y\n");
+  fprintf(stderr, "  filterx cache build -o file1.fxc \"file1:k=1s\"\n");
 }
 
 void
@@ -675,14 +1016,32 @@ apply_key_column_to_file(FileParams* file_params) {
   }
 }
 
+// marks the arguments after option up to end as its value
+static inline void
+mark_option_values(std::vector<bool>* values, int option, int end) {
+  for (int i = option + 1; i < end && i < values->size(); i++) {
+    (*values)[i] = true;
+  }
+}
+
+// values[i] is set if argv[i] is the value of an option, the arguments an
+// option steps over are its value. other arguments not starting with - are
+// inputs
 void
-parse_process_param(int argc, char* argv[], ProcessorParams* processor_params) {
+parse_process_param(int argc, char* argv[], ProcessorParams* processor_params,
+                    std::vector<bool>* values) {
+  values->assign(argc, false);
+  int option = 0;
   // parse process params
   for (int i = 1; i < argc; i++) {
+    mark_option_values(values, option, i);
+    option = i;
     if (argv[i][0] != '-') {
       continue;
     }
+    // a group option, its value is parsed by parse()
     if (argv[i][1] >= '0' && argv[i][1] <= '9') {
+      i++;
       continue;
     }
     if (strcmp(argv[i], "-L") == 0) {
@@ -713,6 +1072,70 @@ parse_process_param(int argc, char* argv[], ProcessorParams* processor_params) {
       i++;
       continue;
     }
+    if (strcmp(argv[i], "-t") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "threads is empty\n");
+        exit(EXIT_FAILURE);
+      }
+      processor_params->threads = std::stoi(argv[i + 1]);
+      if (processor_params->threads < 1) {
+        fprintf(stderr, "threads should be greater than 0, but got %d\n",
+                processor_params->threads);
+        exit(EXIT_FAILURE);
+      }
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--spill-size") == 0) {
+      if (i + 1 >= argc
+          || !parse_size(argv[i + 1], &processor_params->spill_size)) {
+        fprintf(stderr, "spill size is invalid, expect bytes like 256M\n");
+        exit(EXIT_FAILURE);
+      }
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--max-memory") == 0) {
+      if (i + 1 >= argc
+          || !parse_size(argv[i + 1], &processor_params->max_memory)) {
+        fprintf(stderr, "max memory is invalid, expect bytes like 2G\n");
+        exit(EXIT_FAILURE);
+      }
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--agg") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "aggregate is empty\n");
+        exit(EXIT_FAILURE);
+      }
+      std::string error;
+      if (!parse_aggregates(argv[i + 1], &processor_params->aggregates,
+                            &error)) {
+        fprintf(stderr, "parse aggregate error: %s\n", error.c_str());
+        exit(EXIT_FAILURE);
+      }
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--bitmap") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "bitmap format is empty, expect hex or b64\n");
+        exit(EXIT_FAILURE);
+      }
+      if (strcmp(argv[i + 1], "hex") == 0) {
+        processor_params->bitmap = BitmapFormatHex;
+      } else if (strcmp(argv[i + 1], "b64") == 0) {
+        processor_params->bitmap = BitmapFormatBase64;
+      } else {
+        fprintf(stderr, "bitmap format is invalid, expect hex or b64, but got "
+                        "%s\n",
+                argv[i + 1]);
+        exit(EXIT_FAILURE);
+      }
+      i++;
+      continue;
+    }
     if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
       help();
       exit(EXIT_SUCCESS);
@@ -725,6 +1148,101 @@ parse_process_param(int argc, char* argv[], ProcessorParams* processor_params) {
       processor_params->full_mode = true;
       continue;
     }
+    if (strcmp(argv[i], "--kernel") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "kernel is empty, expect auto or generic\n");
+        exit(EXIT_FAILURE);
+      }
+      if (strcmp(argv[i + 1], "auto") == 0) {
+        processor_params->kernel = MergeKernelAuto;
+      } else if (strcmp(argv[i + 1], "generic") == 0) {
+        processor_params->kernel = MergeKernelGeneric;
+      } else {
+        fprintf(stderr, "kernel is invalid, expect auto or generic, but got "
+                        "%s\n",
+                argv[i + 1]);
+        exit(EXIT_FAILURE);
+      }
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--io") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "io is empty, expect sync or uring\n");
+        exit(EXIT_FAILURE);
+      }
+      if (strcmp(argv[i + 1], "sync") == 0) {
+        processor_params->io_mode = IoModeSync;
+      } else if (strcmp(argv[i + 1], "uring") == 0) {
+        processor_params->io_mode = IoModeUring;
+      } else {
+        fprintf(stderr, "io is invalid, expect sync or uring, but got %s\n",
+                argv[i + 1]);
+        exit(EXIT_FAILURE);
+      }
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--intern") == 0) {
+      processor_params->intern = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--stats") == 0
+        || strcmp(argv[i], "--stats=text") == 0) {
+      processor_params->stats = StatsFormatText;
+      continue;
+    }
+    if (strcmp(argv[i], "--stats=json") == 0) {
+      processor_params->stats = StatsFormatJson;
+      continue;
+    }
+    if (strcmp(argv[i], "--trace") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "trace is empty, expect a file\n");
+        exit(EXIT_FAILURE);
+      }
+      processor_params->trace_path = argv[i + 1];
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--contigs") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "contigs is empty, expect a file\n");
+        exit(EXIT_FAILURE);
+      }
+      processor_params->contigs_path = argv[i + 1];
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--counters") == 0) {
+      processor_params->counters = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--progress") == 0) {
+      processor_params->progress = 10;
+      continue;
+    }
+    if (strncmp(argv[i], "--progress=", 11) == 0) {
+      char* end = nullptr;
+      double interval = strtod(argv[i] + 11, &end);
+      if (end == argv[i] + 11 || *end != '\0' || !(interval > 0)) {
+        fprintf(stderr,
+                "progress interval is invalid, expect seconds, but got %s\n",
+                argv[i] + 11);
+        exit(EXIT_FAILURE);
+      }
+      processor_params->progress = interval;
+      continue;
+    }
+    // read by parse() with the other inputs
+    if (strcmp(argv[i], "--files-from") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "files-from is empty, expect a file list\n");
+        exit(EXIT_FAILURE);
+      }
+      i++;
+      continue;
+    }
 
     // parse -cnt=1,100 or -cnt=1, or -cnt=,100
     if (strcmp(argv[i], "-cnt") == 0) {
@@ -825,6 +1343,62 @@ parse_process_param(int argc, char* argv[], ProcessorParams* processor_params) {
     fprintf(stderr, "unknown option: %s\n", argv[i]);
     exit(EXIT_FAILURE);
   }
+  mark_option_values(values, option, argc);
+  if (processor_params->bitmap != BitmapFormatNone
+      && !processor_params->aggregates.empty()) {
+    fprintf(stderr, "--bitmap and --agg can not be used together\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static FileParams
+parse_input(const char* arg, GroupParamsList* group_params_list) {
+  auto file_params = parse_file_params(arg, group_params_list);
+  if (file_params.cut_columns.size() == 1
+      && file_params.cut_columns[0] == -1) {
+    file_params.cut_columns.clear();
+    apply_key_column_to_file(&file_params);
+  }
+  return file_params;
+}
+
+// one <file_name:attribute> per line, empty lines and lines starting with #
+// are skipped. inputs usually share a few attributes, each of them is parsed
+// once and the parsed params are copied for every path
+static void
+parse_files_from(const char* list_path, GroupParamsList* group_params_list,
+                 FileParamsList* file_params_list) {
+  std::ifstream list(list_path);
+  if (!list) {
+    fprintf(stderr, "file list %s does not exist\n", list_path);
+    exit(EXIT_FAILURE);
+  }
+  std::unordered_map<std::string, FileParams> templates;
+  std::string line;
+  while (std::getline(list, line)) {
+    auto spec = trim(line);
+    if (spec.empty() || spec[0] == '#') {
+      continue;
+    }
+    size_t prefix = 0;
+    if (spec.compare(0, sizeof(SHARDS_PREFIX) - 1, SHARDS_PREFIX) == 0) {
+      prefix = sizeof(SHARDS_PREFIX) - 1;
+    }
+    auto pos = spec.find(ARG_SEPARATOR, prefix);
+    auto path = spec.substr(0, pos);
+    std::string attrs;
+    if (pos != std::string_view::npos) {
+      attrs = spec.substr(pos);
+    }
+    auto it = templates.find(attrs);
+    if (it == templates.end()) {
+      it = templates
+               .emplace(attrs, parse_input(attrs.c_str(), group_params_list))
+               .first;
+    }
+    file_params_list->push_back(it->second);
+    file_params_list->back().path = path;
+  }
 }
 
 void
@@ -837,7 +1411,8 @@ parse(int argc, char** argv, GroupParamsList* group_params_list,
   }
 
   // parse process params first
-  parse_process_param(argc, argv, processor_params);
+  std::vector<bool> values;
+  parse_process_param(argc, argv, processor_params, &values);
 
   // parse group params first
   for (int i = 1; i < argc; i++) {
@@ -856,7 +1431,7 @@ parse(int argc, char** argv, GroupParamsList* group_params_list,
 
       // check if group_id exists
       int found = 0;
-      for (auto group_params : *group_params_list) {
+      for (auto& group_params : *group_params_list) {
         auto exist_group_id = std::get<0>(group_params);
         if (exist_group_id == group_id) {
           found = 1;
@@ -876,24 +1451,22 @@ parse(int argc, char** argv, GroupParamsList* group_params_list,
 
   // parse file params
   for (int i = 1; i < argc; i++) {
-    if (argv[i][0] == '-') {
-      if (i + 1 < argc && argv[i + 1][0] == '-') {
-        continue;
-      }
-      i++;
+    if (values[i]) {
       continue;
     }
-    if (argv[i][1] >= '0' && argv[i][1] <= '9') {
+    if (strcmp(argv[i], "--files-from") == 0) {
+      parse_files_from(argv[i + 1], group_params_list, file_params_list);
       i++;
       continue;
     }
-    auto file_params = parse_file_params(argv[i], group_params_list);
-    if (file_params.cut_columns.size() == 1
-        && file_params.cut_columns[0] == -1) {
-      file_params.cut_columns.clear();
-      apply_key_column_to_file(&file_params);
+    if (argv[i][0] == '@') {
+      parse_files_from(argv[i] + 1, group_params_list, file_params_list);
+      continue;
+    }
+    if (argv[i][0] == '-') {
+      continue;
     }
-    file_params_list->push_back(file_params);
+    file_params_list->push_back(parse_input(argv[i], group_params_list));
   }
   check_file_params(file_params_list);
 }
@@ -0,0 +1,217 @@
+#include "perf_counters.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#include <sys/syscall.h>
+#ifdef __NR_perf_event_open
+#define FILTERX_PERF 1
+#endif
+#endif
+#endif
+
+#ifdef FILTERX_PERF
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define FILTERX_RDPMC 1
+#endif
+#endif
+
+namespace filterx {
+
+const char* COUNTER_NAMES[CounterCount] = {
+  "cycles",
+  "instructions",
+  "branch_misses",
+  "llc_misses",
+};
+
+#ifdef FILTERX_PERF
+
+static const uint64_t COUNTER_CONFIGS[CounterCount] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_BRANCH_MISSES,
+  PERF_COUNT_HW_CACHE_MISSES,
+};
+
+PerfCounters::~PerfCounters() { this->close(); }
+
+bool
+PerfCounters::open(std::string* error) {
+  this->close();
+  long page_size = sysconf(_SC_PAGESIZE);
+  for (int i = 0; i < CounterCount; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = COUNTER_CONFIGS[i];
+    // user space only, which is allowed with the default
+    // perf_event_paranoid of 2
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    // the counters are one group, so they count over the same time
+    int group = i == 0 ? -1 : this->fds[0];
+    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+    if (fd < 0) {
+      if (i == 0) {
+        if (error != nullptr) {
+          *error = strerror(errno);
+          if (errno == EACCES || errno == EPERM) {
+            *error += ", see /proc/sys/kernel/perf_event_paranoid";
+          } else if (errno == ENOENT || errno == ENODEV
+                     || errno == EOPNOTSUPP) {
+            *error += ", the cpu or vm has no hardware counters";
+          }
+        }
+        return false;
+      }
+      continue;
+    }
+    this->fds[i] = fd;
+    this->slots[i] = this->nopen++;
+    void* page = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, fd, 0);
+    this->pages[i] = page == MAP_FAILED ? nullptr : page;
+  }
+  return true;
+}
+
+void
+PerfCounters::close() {
+  long page_size = sysconf(_SC_PAGESIZE);
+  // members first, the leader closes the group
+  for (int i = CounterCount - 1; i >= 0; i--) {
+    if (this->pages[i] != nullptr) {
+      munmap(this->pages[i], page_size);
+      this->pages[i] = nullptr;
+    }
+    if (this->fds[i] >= 0) {
+      ::close(this->fds[i]);
+      this->fds[i] = -1;
+    }
+  }
+  this->nopen = 0;
+}
+
+bool
+PerfCounters::fast() {
+#ifdef FILTERX_RDPMC
+  if (this->nopen == 0) {
+    return false;
+  }
+  for (int i = 0; i < CounterCount; i++) {
+    if (this->fds[i] < 0) {
+      continue;
+    }
+    auto page = static_cast<volatile perf_event_mmap_page*>(this->pages[i]);
+    if (page == nullptr || !page->cap_user_rdpmc) {
+      return false;
+    }
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+// without a system call while the counters are on the pmu of this cpu, see
+// the comment on struct perf_event_mmap_page
+bool
+PerfCounters::read_mapped(uint64_t values[CounterCount]) {
+#ifdef FILTERX_RDPMC
+  for (int i = 0; i < CounterCount; i++) {
+    if (this->fds[i] < 0) {
+      values[i] = 0;
+      continue;
+    }
+    auto page = static_cast<volatile perf_event_mmap_page*>(this->pages[i]);
+    if (page == nullptr) {
+      return false;
+    }
+    uint32_t seq;
+    uint64_t count;
+    do {
+      seq = page->lock;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      uint32_t index = page->index;
+      if (!page->cap_user_rdpmc || index == 0) {
+        return false;
+      }
+      int64_t pmc = __rdpmc(index - 1);
+      int width = page->pmc_width;
+      pmc <<= 64 - width;
+      pmc >>= 64 - width;
+      count = page->offset + pmc;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    } while (page->lock != seq);
+    values[i] = count;
+  }
+  return true;
+#else
+  (void)values;
+  return false;
+#endif
+}
+
+void
+PerfCounters::read(uint64_t values[CounterCount]) {
+  if (this->nopen == 0) {
+    memset(values, 0, sizeof(uint64_t) * CounterCount);
+    return;
+  }
+  if (this->read_mapped(values)) {
+    return;
+  }
+  // the number of counters, then their values
+  uint64_t buffer[1 + CounterCount] = {};
+  if (::read(this->fds[0], buffer, sizeof(buffer)) < 0) {
+    memset(values, 0, sizeof(uint64_t) * CounterCount);
+    return;
+  }
+  for (int i = 0; i < CounterCount; i++) {
+    values[i] = this->fds[i] >= 0 ? buffer[1 + this->slots[i]] : 0;
+  }
+}
+
+#else
+
+PerfCounters::~PerfCounters() {}
+
+bool
+PerfCounters::open(std::string* error) {
+  if (error != nullptr) {
+    *error = "not supported on this platform";
+  }
+  return false;
+}
+
+void
+PerfCounters::close() {}
+
+bool
+PerfCounters::fast() {
+  return false;
+}
+
+bool
+PerfCounters::read_mapped(uint64_t values[CounterCount]) {
+  (void)values;
+  return false;
+}
+
+void
+PerfCounters::read(uint64_t values[CounterCount]) {
+  memset(values, 0, sizeof(uint64_t) * CounterCount);
+}
+
+#endif
+
+} // namespace filterx
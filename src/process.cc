@@ -2,27 +2,74 @@
 
 namespace filterx {
 
+static const int64_t MERGE_TRACE_KEYS = 4096;
+
 Processor::Processor(ProcessorParams& params) : params(params) {
   if (strcmp(params.output_path.c_str(), "-") == 0) {
     this->output_file = stdout;
-    return;
+  } else {
+    this->output_file = fopen(params.output_path.c_str(), "w");
+    if (this->output_file == nullptr) {
+      fprintf(stderr, "Failed to open file: %s\n", params.output_path.c_str());
+      fflush(stderr);
+      exit(EXIT_FAILURE);
+    }
   }
-  this->output_file = fopen(params.output_path.c_str(), "w");
-  if (this->output_file == nullptr) {
-    fprintf(stderr, "Failed to open file: %s\n", params.output_path.c_str());
-    fflush(stderr);
-    exit(EXIT_FAILURE);
+  GroupFormatter formatter;
+  if (this->params.row_mode) {
+    formatter = [this](OutputGroup* group, std::string* output_buffer) {
+      this->format_row_mode(group, output_buffer);
+    };
+  } else {
+    formatter = [this](OutputGroup* group, std::string* output_buffer) {
+      this->format_column_mode(group, output_buffer);
+    };
+  }
+  this->pipeline
+      = new OutputPipeline(this->output_file, this->params.threads, formatter);
+}
+
+// all files share the key columns, checked by check_file_params
+void
+Processor::select_kernel(FileParams* params) {
+  if (this->params.kernel == MergeKernelGeneric) {
+    return;
   }
+  this->kernel = create_merge_kernel(params->row_keys, params->key_types,
+                                     params->sort_order);
 }
 
 void
 Processor::add_record(Record* record) {
   this->records.push_back(record);
   record->id = this->records.size();
+  record->buffer()->set_kernel(this->kernel);
+  record->buffer()->set_spill_limit(this->params.spill_size);
+  record->progress.size = record->total_bytes();
+  progress.add(record->get_path(), &record->progress);
+  if (!this->params.aggregates.empty()) {
+    std::vector<int> columns;
+    for (auto& spec : this->params.aggregates) {
+      if (spec.type != AggregateTypeCount) {
+        columns.push_back(spec.column);
+        record->read_column(spec.column);
+      }
+    }
+    record->buffer()->set_aggregate_columns(columns);
+  }
+  if (this->params.full_mode) {
+    record->read_all_columns();
+  }
+  if (this->params.bitmap != BitmapFormatNone) {
+    // only the key of a group is needed
+    record->set_record_limit(1);
+  }
 }
 
 void
 Processor::prepare() {
+  StageScope scope(StageMerge);
+  TraceSpan span("prepare", "merge");
   for (int i = 0; i < this->records.size(); i++) {
     RecordStatus s;
     while (1) {
@@ -42,94 +89,180 @@ Processor::prepare() {
   }
 }
 
-// column mode
+// hand the rows of every record in WaitOutput to the output pipeline
 void
 Processor::flush_all_records_to_file() {
-  int max_rows = 0;
+  auto group = this->pipeline->next_group(this->records.size());
+  bool spilled = false;
   for (int i = 0; i < this->records.size(); i++) {
-    if (this->records[i]->record_status != RecordStatusWaitOutput) {
+    auto record = this->records[i];
+    if (record->record_status != RecordStatusWaitOutput) {
       continue;
     }
+    auto slot = &group->slots[i];
+    slot->present = true;
+    slot->nrows = record->get_record_limit();
+    group->memory += record->buffer()->memory_size();
+    record->buffer()->take_rows(&slot->rows, &slot->spill);
+    if (slot->spill && slot->spill->size() > 0) {
+      spilled = true;
+    }
+  }
+  this->pipeline->commit_group(spilled);
+}
+
+// append the key columns of the current output group
+void
+Processor::append_key(std::string* output_buffer) {
+  RowKey* key = nullptr;
+  for (int i = 0; i < this->records.size(); i++) {
+    if (this->records[i]->record_status == RecordStatusWaitOutput) {
+      key = this->records[i]->key().value_or(nullptr);
+      break;
+    }
+  }
+  assert(key != nullptr);
+  for (int i = 0; i < key->size(); i++) {
+    auto k = key->get_key(i).value_or(nullptr);
+    assert(k != nullptr);
+    output_buffer->append(k->to_string());
+    output_buffer->push_back(this->params.output_separator);
+  }
+}
+
+// aggregate mode, one line per key: the key columns, then the statistics of
+// every record, placeholders for records without the key
+void
+Processor::flush_aggregate() {
+  auto output_buffer = this->pipeline->direct_buffer();
+  this->append_key(output_buffer);
+  char buff[32];
+  for (int i = 0; i < this->records.size(); i++) {
     auto record = this->records[i];
-    if (record->cut_columns.empty()) {
+    bool present = record->record_status == RecordStatusWaitOutput;
+    for (auto& spec : this->params.aggregates) {
+      if (!present) {
+        output_buffer->push_back(record->placehoder);
+      } else if (spec.type == AggregateTypeCount) {
+        int len = snprintf(buff, sizeof(buff), "%zu", record->buffer()->size());
+        output_buffer->append(buff, len);
+      } else {
+        auto column = record->buffer()->aggregate_column(spec.column);
+        if (!column->format(spec.type, output_buffer)) {
+          output_buffer->push_back(record->placehoder);
+        }
+      }
+      output_buffer->push_back(this->params.output_separator);
+    }
+  }
+  // change the last separator to newline
+  output_buffer->pop_back();
+  output_buffer->push_back('\n');
+  this->pipeline->flush_if_full(output_buffer);
+}
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+static const char BASE64_DIGITS[]
+    = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// bitmap mode, one line per key: the key columns, then a bitset of the
+// records that have the key, record i is bit (i % 8) of byte (i / 8)
+void
+Processor::flush_bitmap() {
+  auto output_buffer = this->pipeline->direct_buffer();
+  this->append_key(output_buffer);
+  this->bitmap.assign((this->records.size() + 7) / 8, 0);
+  for (int i = 0; i < this->records.size(); i++) {
+    if (this->records[i]->record_status == RecordStatusWaitOutput) {
+      this->bitmap[i / 8] |= 1 << (i % 8);
+    }
+  }
+  auto bytes = this->bitmap.data();
+  size_t nbytes = this->bitmap.size();
+  if (this->params.bitmap == BitmapFormatHex) {
+    for (size_t i = 0; i < nbytes; i++) {
+      output_buffer->push_back(HEX_DIGITS[bytes[i] >> 4]);
+      output_buffer->push_back(HEX_DIGITS[bytes[i] & 0xf]);
+    }
+  } else {
+    for (size_t i = 0; i < nbytes; i += 3) {
+      uint32_t v = bytes[i] << 16;
+      if (i + 1 < nbytes) {
+        v |= bytes[i + 1] << 8;
+      }
+      if (i + 2 < nbytes) {
+        v |= bytes[i + 2];
+      }
+      output_buffer->push_back(BASE64_DIGITS[(v >> 18) & 0x3f]);
+      output_buffer->push_back(BASE64_DIGITS[(v >> 12) & 0x3f]);
+      output_buffer->push_back(i + 1 < nbytes ? BASE64_DIGITS[(v >> 6) & 0x3f]
+                                              : '=');
+      output_buffer->push_back(i + 2 < nbytes ? BASE64_DIGITS[v & 0x3f] : '=');
+    }
+  }
+  output_buffer->push_back('\n');
+  this->pipeline->flush_if_full(output_buffer);
+}
+
+// column mode
+void
+Processor::format_column_mode(OutputGroup* group, std::string* output_buffer) {
+  size_t max_rows = 0;
+  for (int i = 0; i < this->records.size(); i++) {
+    auto slot = &group->slots[i];
+    if (!slot->present || this->records[i]->cut_columns.empty()) {
       continue;
     }
-    auto nrows = record->get_record_limit();
-    if (nrows > max_rows) {
-      max_rows = nrows;
+    if (slot->nrows > max_rows) {
+      max_rows = slot->nrows;
     }
   }
-  auto output_buffer = this->output_buffer;
-  for (int n = 0; n < max_rows; n++) {
+  for (size_t n = 0; n < max_rows; n++) {
     for (int i = 0; i < this->records.size(); i++) {
-      if (this->records[i]->record_status != RecordStatusWaitOutput) {
-        auto cut = &this->records[i]->cut_columns;
-        char placehoder = this->records[i]->placehoder;
-        for (int j = 0; j < cut->size(); j++) {
-          // fprintf(this->output_file, "%c%c", placehoder,
-          //         this->params.output_separator);
-          output_buffer.push_back(placehoder);
-          output_buffer.push_back(this->params.output_separator);
-        }
-        continue;
-      }
       auto record = this->records[i];
-      auto buffer = record->buffer();
+      auto slot = &group->slots[i];
       auto cut = &record->cut_columns;
-      if (n >= record->get_record_limit()) {
-        char placehoder = record->placehoder;
+      char placehoder = record->placehoder;
+      if (!slot->present || n >= slot->nrows) {
         for (int j = 0; j < cut->size(); j++) {
-          // fprintf(this->output_file, "%c%c", placehoder,
-          //         this->params.output_separator);
-          output_buffer.push_back(placehoder);
-          output_buffer.push_back(this->params.output_separator);
+          output_buffer->push_back(placehoder);
+          output_buffer->push_back(this->params.output_separator);
         }
         continue;
       }
-      auto row = buffer->get_row(n).value_or(nullptr);
-      char placehoder = record->placehoder;
+      auto row = slot->get_row(n);
       for (int j = 0; j < cut->size(); j++) {
         auto item = row->get_item(cut->at(j));
         if (item.has_value()) {
-          auto item_value = item.value();
-          // fprintf(this->output_file, "%s%c", item_value.data(),
-          //         this->params.output_separator);
-          output_buffer.append(item_value.data());
-          output_buffer.push_back(this->params.output_separator);
+          output_buffer->append(item.value());
         } else {
-          // fprintf(this->output_file, "%c%c", placehoder,
-          //         this->params.output_separator);
-          output_buffer.push_back(placehoder);
-          output_buffer.push_back(this->params.output_separator);
+          output_buffer->push_back(placehoder);
         }
+        output_buffer->push_back(this->params.output_separator);
       }
     }
     // change the last separator to newline
-    output_buffer.pop_back();
-    output_buffer.push_back('\n');
+    output_buffer->pop_back();
+    output_buffer->push_back('\n');
+    this->pipeline->flush_if_full(output_buffer);
   }
-  fwrite(output_buffer.data(), 1, output_buffer.size(), this->output_file);
 }
 
 // row mode
 void
-Processor::flush_all_records_to_file_row_mode() {
-  auto output_buffer = this->output_buffer;
-  output_buffer.clear();
+Processor::format_row_mode(OutputGroup* group, std::string* output_buffer) {
   for (int i = 0; i < this->records.size(); i++) {
-    if (this->records[i]->record_status != RecordStatusWaitOutput) {
+    auto slot = &group->slots[i];
+    if (!slot->present) {
       continue;
     }
     auto record = this->records[i];
-    auto buffer = record->buffer();
-    auto nrows = record->get_record_limit();
-    auto placehoder = record->placehoder;
     auto cut = &record->cut_columns;
     if (cut->empty()) {
       continue;
     }
-    for (int n = 0; n < nrows; n++) {
-      auto row = buffer->get_row(n).value_or(nullptr);
+    for (size_t n = 0; n < slot->nrows; n++) {
+      auto row = slot->get_row(n);
       int ncol = cut->size();
       if (this->params.full_mode) {
         ncol = row->size();
@@ -143,24 +276,18 @@ Processor::flush_all_records_to_file_row_mode() {
         }
         auto item = row->get_item(item_index);
         if (item.has_value()) {
-          auto item_value = item.value();
-          // fprintf(this->output_file, "%s%c", item_value.data(),
-          //         this->params.output_separator);
-          output_buffer.append(item_value.data());
-          output_buffer.push_back(this->params.output_separator);
+          output_buffer->append(item.value());
         } else {
-          // fprintf(this->output_file, "%c%c", record->get_placehoder(),
-          //         this->params.output_separator);
-          output_buffer.push_back(record->placehoder);
-          output_buffer.push_back(this->params.output_separator);
+          output_buffer->push_back(record->placehoder);
         }
+        output_buffer->push_back(this->params.output_separator);
       }
       // change the last separator to newline
-      output_buffer.pop_back();
-      output_buffer.push_back('\n');
+      output_buffer->pop_back();
+      output_buffer->push_back('\n');
+      this->pipeline->flush_if_full(output_buffer);
     }
   }
-  fwrite(output_buffer.data(), 1, output_buffer.size(), this->output_file);
 }
 
 void
@@ -309,11 +436,25 @@ Processor::process() {
     fflush(stderr);
     return;
   }
+  StageScope scope(StageMerge);
   uint32_t ouput_number = 0;
   int stop = false;
+  // the merge is traced in spans of MERGE_TRACE_KEYS keys
+  uint64_t trace_begin = stats_ticks();
+  int64_t trace_keys = 0;
   while (!stop) {
+    if (progress.wanted()) {
+      this->write_progress_keys();
+    }
+    if (tracer.on() && ++trace_keys == MERGE_TRACE_KEYS) {
+      tracer.add("merge", "merge", trace_begin, nullptr, "keys", trace_keys);
+      trace_begin = stats_ticks();
+      trace_keys = 0;
+    }
     int c = 0;
-    auto* topest_keys = the_topest_key(this->records, &c);
+    auto* topest_keys = this->kernel != nullptr
+                            ? this->kernel->topest_key(this->records, &c)
+                            : the_topest_key(this->records, &c);
     if (topest_keys == nullptr) {
       break;
     }
@@ -333,29 +474,40 @@ Processor::process() {
     }
 
     if (drop_all) {
+      for (auto record : this->records) {
+        if (record->record_status == RecordStatusWaitOutput) {
+          record->stats.dropped_exist++;
+        }
+      }
+      stats.dropped_groups++;
       this->drop_all_records_and_update_next();
       continue;
     }
 
     // check if the number of records is within the range
     if (c < this->params.min_count || c > this->params.max_count) {
+      stats.dropped_groups++;
       this->drop_all_records_and_update_next();
       continue;
     }
     float fc = 1.0 * c / this->records.size();
     if (fc < this->params.fmin_count || fc > this->params.fmax_count) {
+      stats.dropped_groups++;
       this->drop_all_records_and_update_next();
       continue;
     }
-    if (this->params.row_mode) {
-      this->flush_all_records_to_file_row_mode();
+    if (this->params.bitmap != BitmapFormatNone) {
+      this->flush_bitmap();
+    } else if (!this->params.aggregates.empty()) {
+      this->flush_aggregate();
     } else {
       this->flush_all_records_to_file();
     }
     ouput_number++;
+    stats.output_groups++;
     if (this->params.output_limit > 0
         && ouput_number >= this->params.output_limit) {
-      return;
+      break;
     }
 
     for (int i = 0; i < this->records.size(); i++) {
@@ -370,6 +522,29 @@ Processor::process() {
       }
     }
   }
+  if (tracer.on() && trace_keys > 0) {
+    tracer.add("merge", "merge", trace_begin, nullptr, "keys", trace_keys);
+  }
+  this->pipeline->finish();
+}
+
+void
+Processor::write_progress_keys() {
+  std::lock_guard<std::mutex> lock(progress.mutex);
+  for (auto record : this->records) {
+    record->write_progress_key(',');
+  }
+  progress.keys_written();
+}
+
+void
+Processor::report_stats(FILE* file) {
+  std::vector<FileStatsEntry> files;
+  for (auto record : this->records) {
+    files.push_back({ record->get_path(), record->bytes_read(),
+                      &record->stats });
+  }
+  stats.report(file, files);
 }
 
 } // namespace filterx
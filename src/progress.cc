@@ -0,0 +1,173 @@
+#include "progress.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+
+namespace filterx {
+
+Progress progress;
+
+// how long a report waits for the merge thread to write the keys, it may be
+// busy with a large group or blocked on output
+static const auto KEYS_TIMEOUT = std::chrono::seconds(1);
+
+#ifdef SIGUSR1
+// how often the reporter looks for a signal
+static const auto SIGNAL_POLL = std::chrono::milliseconds(100);
+
+static volatile sig_atomic_t progress_signal = 0;
+
+static void
+on_progress_signal(int) {
+  progress_signal = 1;
+}
+
+static void
+install_progress_signal() {
+#ifdef SA_RESTART
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_progress_signal;
+  sigemptyset(&action.sa_mask);
+  // reads and writes go on after the handler returns
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &action, nullptr);
+#else
+  signal(SIGUSR1, on_progress_signal);
+#endif
+}
+#endif
+
+void
+Progress::add(const std::string& path, RecordProgress* record) {
+  this->entries.push_back({ path, record });
+}
+
+void
+Progress::start(double interval) {
+  this->interval = interval;
+  this->start_time = std::chrono::steady_clock::now();
+#ifdef SIGUSR1
+  install_progress_signal();
+#else
+  if (interval <= 0) {
+    return;
+  }
+#endif
+  this->thread = std::thread(&Progress::run, this);
+}
+
+void
+Progress::stop() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+  this->cv.notify_all();
+  if (this->thread.joinable()) {
+    this->thread.join();
+  }
+}
+
+void
+Progress::keys_written() {
+  this->keys_wanted.store(false, std::memory_order_relaxed);
+  this->cv.notify_all();
+}
+
+void
+Progress::run() {
+  auto next = std::chrono::steady_clock::time_point::max();
+  if (this->interval > 0) {
+    next = this->start_time
+           + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+               std::chrono::duration<double>(this->interval));
+  }
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while (!this->stopping) {
+    auto wake = next;
+#ifdef SIGUSR1
+    wake = std::min(wake, std::chrono::steady_clock::now() + SIGNAL_POLL);
+#endif
+    this->cv.wait_until(lock, wake, [this] { return this->stopping; });
+    if (this->stopping) {
+      break;
+    }
+    bool due = std::chrono::steady_clock::now() >= next;
+#ifdef SIGUSR1
+    if (progress_signal) {
+      progress_signal = 0;
+      due = true;
+    }
+#endif
+    if (!due) {
+      continue;
+    }
+    this->report(lock);
+    if (this->interval > 0) {
+      while (next <= std::chrono::steady_clock::now()) {
+        next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(this->interval));
+      }
+    }
+  }
+}
+
+void
+Progress::report(std::unique_lock<std::mutex>& lock) {
+  this->keys_wanted.store(true, std::memory_order_relaxed);
+  // without an answer the keys of the last report are shown
+  this->cv.wait_for(lock, KEYS_TIMEOUT, [this] {
+    return this->stopping || !this->keys_wanted.load();
+  });
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - this->start_time)
+                       .count();
+  uint64_t total_bytes = 0;
+  uint64_t total_size = 0;
+  uint64_t total_groups = 0;
+  bool sized = true;
+  for (auto& entry : this->entries) {
+    total_bytes += entry.record->bytes.load(std::memory_order_relaxed);
+    total_groups += entry.record->groups.load(std::memory_order_relaxed);
+    total_size += entry.record->size;
+    if (entry.record->size == 0) {
+      sized = false;
+    }
+  }
+  double mb = total_bytes / 1048576.0;
+  fprintf(stderr, "progress: %.1fs, %.1f MB at %.1f MB/s, %llu groups at "
+                  "%.0f groups/s",
+          elapsed, mb, elapsed > 0 ? mb / elapsed : 0,
+          (unsigned long long)total_groups,
+          elapsed > 0 ? total_groups / elapsed : 0);
+  if (sized && total_size > 0) {
+    double done = std::min(1.0, 1.0 * total_bytes / total_size);
+    fprintf(stderr, ", %.1f%% done", done * 100);
+    if (done > 0) {
+      fprintf(stderr, ", about %.0fs left", elapsed * (1 - done) / done);
+    }
+  }
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  %-24s %14s %14s %7s %12s  %s\n", "path", "bytes", "size",
+          "done", "groups", "key");
+  for (auto& entry : this->entries) {
+    auto record = entry.record;
+    uint64_t bytes = record->bytes.load(std::memory_order_relaxed);
+    char done[16] = "-";
+    if (record->size > 0) {
+      snprintf(done, sizeof(done), "%.1f%%",
+               std::min(100.0, 100.0 * bytes / record->size));
+    }
+    fprintf(stderr, "  %-24s %14llu %14llu %7s %12llu  %s\n",
+            entry.path.c_str(), (unsigned long long)bytes,
+            (unsigned long long)record->size, done,
+            (unsigned long long)record->groups.load(std::memory_order_relaxed),
+            record->eof.load(std::memory_order_relaxed) ? "(eof)"
+                                                        : record->key.c_str());
+  }
+  fflush(stderr);
+}
+
+} // namespace filterx
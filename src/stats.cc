@@ -0,0 +1,396 @@
+#include "stats.h"
+
+#include <cstring>
+#include <ctime>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace filterx {
+
+Stats stats;
+
+static const char* STAGE_NAMES[StageCount] = {
+  "read", "decompress", "split", "group", "merge", "format", "write",
+};
+
+// the clock of a thread is kept for the report, its counters are closed when
+// the thread ends
+struct ThreadClock {
+  StageClock* clock = nullptr;
+
+  ~ThreadClock() {
+    if (this->clock != nullptr && this->clock->counters != nullptr) {
+      this->clock->exact_counters = false;
+      delete this->clock->counters;
+      this->clock->counters = nullptr;
+    }
+  }
+};
+
+static thread_local ThreadClock current_clock;
+
+static double
+thread_cpu_seconds() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+#endif
+  return 0;
+}
+
+void
+StageClock::sample_cpu(uint64_t now) {
+  double cpu_seconds = thread_cpu_seconds();
+  bool sample_events = this->counters != nullptr && !this->exact_counters;
+  uint64_t values[CounterCount];
+  if (sample_events) {
+    this->counters->read(values);
+  }
+  if (this->cpu_seconds >= 0) {
+    double delta = cpu_seconds - this->cpu_seconds;
+    uint64_t total = 0;
+    for (int i = 0; i < StageCount; i++) {
+      total += this->pending[i];
+    }
+    if (total > 0) {
+      for (int i = 0; i < StageCount; i++) {
+        double share = 1.0 * this->pending[i] / total;
+        this->cpu[i] += delta * share;
+        if (sample_events) {
+          for (int j = 0; j < CounterCount; j++) {
+            this->events[i][j] += (values[j] - this->last_events[j]) * share;
+          }
+        }
+        this->pending[i] = 0;
+      }
+    }
+  }
+  if (sample_events) {
+    memcpy(this->last_events, values, sizeof(values));
+  }
+  this->cpu_seconds = cpu_seconds;
+  this->sampled = now;
+}
+
+void
+StageClock::count_events(int previous) {
+  uint64_t values[CounterCount];
+  this->counters->read(values);
+  if (previous != StageNone) {
+    for (int i = 0; i < CounterCount; i++) {
+      this->events[previous][i] += values[i] - this->last_events[i];
+    }
+  }
+  memcpy(this->last_events, values, sizeof(values));
+}
+
+void
+Stats::enable(StatsFormat format, bool counters) {
+  this->format = format;
+  this->counters = counters;
+  this->start_ticks = stats_ticks();
+  this->start_time = std::chrono::steady_clock::now();
+}
+
+StageClock*
+Stats::thread_clock() {
+  if (current_clock.clock == nullptr) {
+    auto clock = new StageClock();
+    if (this->counters) {
+      clock->counters = this->open_counters();
+      clock->exact_counters
+          = clock->counters != nullptr && clock->counters->fast();
+    }
+    current_clock.clock = clock;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (clock->counters != nullptr && !clock->exact_counters) {
+      this->counters_sampled = true;
+    }
+    this->clocks.push_back(clock);
+  }
+  return current_clock.clock;
+}
+
+// nullptr if the kernel does not allow them, the reason is reported once
+PerfCounters*
+Stats::open_counters() {
+  auto counters = new PerfCounters();
+  std::string error;
+  bool opened = counters->open(&error);
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (!opened) {
+    delete counters;
+    if (this->counters_error.empty() && !this->counters_opened) {
+      this->counters_error = error;
+    }
+    return nullptr;
+  }
+  if (!this->counters_opened) {
+    this->counters_opened = true;
+    this->counters_error.clear();
+    for (int i = 0; i < CounterCount; i++) {
+      this->has_counter[i] = counters->has(i);
+    }
+  }
+  return counters;
+}
+
+void
+Stats::report(FILE* file, std::vector<FileStatsEntry>& files) {
+  auto end_ticks = stats_ticks();
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                              - this->start_time)
+                    .count();
+  double tick_seconds = 0;
+  if (end_ticks > this->start_ticks) {
+    tick_seconds = wall / (end_ticks - this->start_ticks);
+  }
+  double user = 0;
+  double sys = 0;
+#ifdef _WIN32
+  user = static_cast<double>(clock()) / CLOCKS_PER_SEC;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    sys = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  }
+#endif
+  if (this->format == StatsFormatJson) {
+    this->report_json(file, files, wall, user, sys, tick_seconds);
+  } else {
+    this->report_text(file, files, wall, user, sys, tick_seconds);
+  }
+}
+
+void
+Stats::report_text(FILE* file, std::vector<FileStatsEntry>& files,
+                   double wall, double user, double sys, double tick_seconds) {
+  fprintf(file, "files:\n");
+  fprintf(file, "  %-24s %14s %12s %10s %12s %10s %10s %10s\n", "path",
+          "bytes", "lines", "comments", "groups", "drop_m/M", "drop_req",
+          "drop_key");
+  for (auto& entry : files) {
+    auto s = entry.stats;
+    fprintf(file, "  %-24s %14llu %12llu %10llu %12llu %10llu %10llu %10llu\n",
+            entry.path.c_str(), (unsigned long long)entry.bytes,
+            (unsigned long long)s->lines, (unsigned long long)s->comments,
+            (unsigned long long)s->groups,
+            (unsigned long long)s->dropped_count,
+            (unsigned long long)s->dropped_exist,
+            (unsigned long long)s->dropped_key);
+  }
+  fprintf(file, "stages (seconds, summed over threads):\n");
+  fprintf(file, "  %-24s %10s %10s\n", "stage", "wall", "cpu");
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (int i = 0; i < StageCount; i++) {
+    uint64_t ticks = 0;
+    double cpu = 0;
+    for (auto clock : this->clocks) {
+      ticks += clock->wall[i];
+      cpu += clock->cpu[i];
+    }
+    fprintf(file, "  %-24s %10.3f %10.3f\n", STAGE_NAMES[i],
+            ticks * tick_seconds, cpu);
+  }
+  if (this->counters) {
+    this->report_counters_text(file);
+  }
+  if (ALLOC_STATS) {
+    this->report_allocs_text(file);
+  }
+  fprintf(file, "output:\n");
+  fprintf(file, "  %-24s %14llu\n", "groups",
+          (unsigned long long)this->output_groups);
+  fprintf(file, "  %-24s %14llu\n", "dropped_groups",
+          (unsigned long long)this->dropped_groups);
+  fprintf(file, "  %-24s %14llu\n", "bytes",
+          (unsigned long long)this->output_bytes.load());
+  fprintf(file, "process (seconds):\n");
+  fprintf(file, "  %-24s %10.3f\n", "wall", wall);
+  fprintf(file, "  %-24s %10.3f\n", "user", user);
+  fprintf(file, "  %-24s %10.3f\n", "sys", sys);
+}
+
+void
+write_json_string(FILE* file, const std::string& s) {
+  fputc('"', file);
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      fprintf(file, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(file, "\\u%04x", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+void
+Stats::report_json(FILE* file, std::vector<FileStatsEntry>& files,
+                   double wall, double user, double sys, double tick_seconds) {
+  fprintf(file, "{\"files\":[");
+  for (size_t i = 0; i < files.size(); i++) {
+    auto s = files[i].stats;
+    fprintf(file, "%s{\"path\":", i > 0 ? "," : "");
+    write_json_string(file, files[i].path);
+    fprintf(file,
+            ",\"bytes\":%llu,\"lines\":%llu,\"comments\":%llu,\"groups\":%llu,"
+            "\"dropped_count\":%llu,\"dropped_req\":%llu,"
+            "\"dropped_key\":%llu}",
+            (unsigned long long)files[i].bytes, (unsigned long long)s->lines,
+            (unsigned long long)s->comments, (unsigned long long)s->groups,
+            (unsigned long long)s->dropped_count,
+            (unsigned long long)s->dropped_exist,
+            (unsigned long long)s->dropped_key);
+  }
+  fprintf(file, "],\"stages\":{");
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (int i = 0; i < StageCount; i++) {
+    uint64_t ticks = 0;
+    double cpu = 0;
+    for (auto clock : this->clocks) {
+      ticks += clock->wall[i];
+      cpu += clock->cpu[i];
+    }
+    fprintf(file, "%s\"%s\":{\"wall\":%.6f,\"cpu\":%.6f}", i > 0 ? "," : "",
+            STAGE_NAMES[i], ticks * tick_seconds, cpu);
+  }
+  fprintf(file, "},");
+  if (this->counters) {
+    this->report_counters_json(file);
+  }
+  if (ALLOC_STATS) {
+    this->report_allocs_json(file);
+  }
+  fprintf(file,
+          "\"output\":{\"groups\":%llu,\"dropped_groups\":%llu,"
+          "\"bytes\":%llu},",
+          (unsigned long long)this->output_groups,
+          (unsigned long long)this->dropped_groups,
+          (unsigned long long)this->output_bytes.load());
+  fprintf(file, "\"process\":{\"wall\":%.6f,\"user\":%.6f,\"sys\":%.6f}}\n",
+          wall, user, sys);
+}
+
+// called with mutex held
+void
+Stats::report_counters_text(FILE* file) {
+  if (!this->counters_opened) {
+    fprintf(file, "counters: not available, %s\n",
+            this->counters_error.c_str());
+    return;
+  }
+  // without rdpmc the counters are read with the cpu time and split over
+  // the stages by their wall time
+  fprintf(file, "counters (user space, summed over threads%s):\n",
+          this->counters_sampled ? ", sampled" : "");
+  fprintf(file, "  %-24s %16s %16s %6s %14s %14s\n", "stage", "cycles",
+          "instructions", "ipc", "branch_misses", "llc_misses");
+  for (int i = 0; i < StageCount; i++) {
+    uint64_t events[CounterCount] = {};
+    for (auto clock : this->clocks) {
+      for (int j = 0; j < CounterCount; j++) {
+        events[j] += clock->events[i][j];
+      }
+    }
+    char values[CounterCount][24];
+    for (int j = 0; j < CounterCount; j++) {
+      if (this->has_counter[j]) {
+        snprintf(values[j], sizeof(values[j]), "%llu",
+                 (unsigned long long)events[j]);
+      } else {
+        snprintf(values[j], sizeof(values[j]), "-");
+      }
+    }
+    char ipc[16] = "-";
+    if (this->has_counter[CounterInstructions] && events[CounterCycles] > 0) {
+      snprintf(ipc, sizeof(ipc), "%.2f",
+               1.0 * events[CounterInstructions] / events[CounterCycles]);
+    }
+    fprintf(file, "  %-24s %16s %16s %6s %14s %14s\n", STAGE_NAMES[i],
+            values[CounterCycles], values[CounterInstructions], ipc,
+            values[CounterBranchMisses], values[CounterLlcMisses]);
+  }
+}
+
+// called with mutex held, a counter the cpu does not have is null
+void
+Stats::report_counters_json(FILE* file) {
+  if (!this->counters_opened) {
+    fprintf(file, "\"counters\":null,\"counters_error\":");
+    write_json_string(file, this->counters_error);
+    fprintf(file, ",");
+    return;
+  }
+  fprintf(file, "\"counters_sampled\":%s,\"counters\":{",
+          this->counters_sampled ? "true" : "false");
+  for (int i = 0; i < StageCount; i++) {
+    fprintf(file, "%s\"%s\":{", i > 0 ? "," : "", STAGE_NAMES[i]);
+    for (int j = 0; j < CounterCount; j++) {
+      uint64_t total = 0;
+      for (auto clock : this->clocks) {
+        total += clock->events[i][j];
+      }
+      fprintf(file, "%s\"%s\":", j > 0 ? "," : "", COUNTER_NAMES[j]);
+      if (this->has_counter[j]) {
+        fprintf(file, "%llu", (unsigned long long)total);
+      } else {
+        fprintf(file, "null");
+      }
+    }
+    fprintf(file, "}");
+  }
+  fprintf(file, "},");
+}
+
+// called with mutex held. other counts allocations outside any stage,
+// before --stats was parsed and of threads without a clock
+void
+Stats::report_allocs_text(FILE* file) {
+  auto total = alloc_total();
+  fprintf(file, "allocations (operator new, summed over threads):\n");
+  fprintf(file, "  %-24s %14s %16s\n", "stage", "calls", "bytes");
+  for (int i = 0; i < StageCount; i++) {
+    AllocCounts counts;
+    for (auto clock : this->clocks) {
+      counts.calls += clock->allocs[i].calls;
+      counts.bytes += clock->allocs[i].bytes;
+    }
+    total.calls -= counts.calls;
+    total.bytes -= counts.bytes;
+    fprintf(file, "  %-24s %14llu %16llu\n", STAGE_NAMES[i],
+            (unsigned long long)counts.calls,
+            (unsigned long long)counts.bytes);
+  }
+  fprintf(file, "  %-24s %14llu %16llu\n", "other",
+          (unsigned long long)total.calls, (unsigned long long)total.bytes);
+}
+
+// called with mutex held
+void
+Stats::report_allocs_json(FILE* file) {
+  auto total = alloc_total();
+  fprintf(file, "\"allocations\":{");
+  for (int i = 0; i < StageCount; i++) {
+    AllocCounts counts;
+    for (auto clock : this->clocks) {
+      counts.calls += clock->allocs[i].calls;
+      counts.bytes += clock->allocs[i].bytes;
+    }
+    total.calls -= counts.calls;
+    total.bytes -= counts.bytes;
+    fprintf(file, "\"%s\":{\"calls\":%llu,\"bytes\":%llu},", STAGE_NAMES[i],
+            (unsigned long long)counts.calls,
+            (unsigned long long)counts.bytes);
+  }
+  fprintf(file, "\"other\":{\"calls\":%llu,\"bytes\":%llu}},",
+          (unsigned long long)total.calls, (unsigned long long)total.bytes);
+}
+
+} // namespace filterx
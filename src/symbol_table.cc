@@ -0,0 +1,115 @@
+#include "symbol_table.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace filterx {
+
+SymbolTable symbol_table;
+
+static const size_t SYMBOL_INITIAL_SLOTS = 1 << 12;
+
+static inline uint64_t
+prefix_word(std::string_view key) {
+  uint64_t word = 0;
+  for (size_t i = 0; i < 8; i++) {
+    word <<= 8;
+    if (i < key.size()) {
+      word |= static_cast<unsigned char>(key[i]);
+    }
+  }
+  return word;
+}
+
+KeyValue
+SymbolTable::intern(std::string_view key) {
+  if (this->slots.empty()) {
+    this->slots.resize(SYMBOL_INITIAL_SLOTS);
+  }
+  uint64_t hash = std::hash<std::string_view>()(key);
+  size_t mask = this->slots.size() - 1;
+  size_t i = hash & mask;
+  while (this->slots[i].id != 0) {
+    auto slot = &this->slots[i];
+    if (slot->hash == hash && this->keys[slot->id - 1] == key) {
+      KeyValue value;
+      value.symbol.id = slot->id;
+      value.symbol.generation = this->generation;
+      return value;
+    }
+    i = (i + 1) & mask;
+  }
+
+  if (this->keys.size() >= SYMBOL_TABLE_LIMIT
+      || (this->keys.size() >= SYMBOL_PRESSURE_LIMIT
+          && memory_governor.over_budget())) {
+    this->reset();
+    return this->intern(key);
+  }
+  if ((this->keys.size() + 1) * 2 > this->slots.size()) {
+    this->grow();
+    return this->intern(key);
+  }
+  this->keys.push_back(this->store(key));
+  this->prefixes.push_back(prefix_word(key));
+  this->slots[i].hash = hash;
+  this->slots[i].id = this->keys.size();
+  this->memory.update(this->text_size + this->slots.capacity() * sizeof(Slot)
+                      + this->keys.capacity() * sizeof(std::string_view)
+                      + this->prefixes.capacity() * sizeof(uint64_t));
+
+  KeyValue value;
+  value.symbol.id = this->slots[i].id;
+  value.symbol.generation = this->generation;
+  return value;
+}
+
+void
+SymbolTable::grow() {
+  std::vector<Slot> slots(this->slots.size() * 2);
+  size_t mask = slots.size() - 1;
+  for (auto& slot : this->slots) {
+    if (slot.id == 0) {
+      continue;
+    }
+    size_t i = slot.hash & mask;
+    while (slots[i].id != 0) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = slot;
+  }
+  this->slots.swap(slots);
+}
+
+void
+SymbolTable::reset() {
+  this->slots.assign(SYMBOL_INITIAL_SLOTS, Slot{ 0, 0 });
+  this->slots.shrink_to_fit();
+  this->keys.clear();
+  this->prefixes.clear();
+  this->chunks.clear();
+  this->chunk_used = SYMBOL_CHUNK_SIZE;
+  this->text_size = 0;
+  this->generation++;
+}
+
+// keys are copied into chunks that are never moved, so the views stay valid
+// until the table is reset
+std::string_view
+SymbolTable::store(std::string_view key) {
+  if (key.size() > SYMBOL_CHUNK_SIZE - this->chunk_used) {
+    size_t size = std::max(SYMBOL_CHUNK_SIZE, key.size());
+    this->chunks.emplace_back(new char[size]);
+    this->chunk_used = 0;
+    this->text_size += size;
+  }
+  char* data = this->chunks.back().get() + this->chunk_used;
+  memcpy(data, key.data(), key.size());
+  // a key longer than a chunk fills its own chunk
+  this->chunk_used
+      = std::min(this->chunk_used + key.size(), SYMBOL_CHUNK_SIZE);
+  return std::string_view(data, key.size());
+}
+
+} // namespace filterx
@@ -0,0 +1,153 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace filterx {
+
+Tracer tracer;
+
+static thread_local ThreadTrace* current_trace = nullptr;
+
+ThreadTrace::~ThreadTrace() {
+  auto chunk = this->first.load();
+  while (chunk != nullptr) {
+    auto next = chunk->next.load();
+    delete chunk;
+    chunk = next;
+  }
+}
+
+bool
+ThreadTrace::grow() {
+  if (this->nchunks * CHUNK_EVENTS >= MAX_EVENTS) {
+    return false;
+  }
+  auto chunk = new Chunk();
+  if (this->last == nullptr) {
+    this->first.store(chunk, std::memory_order_release);
+  } else {
+    this->last->next.store(chunk, std::memory_order_release);
+  }
+  this->last = chunk;
+  this->nchunks++;
+  return true;
+}
+
+Tracer::~Tracer() {
+  if (this->file != nullptr) {
+    fclose(this->file);
+  }
+  for (auto thread : this->threads) {
+    delete thread;
+  }
+}
+
+// the file is opened at once, so a bad path fails before the merge
+void
+Tracer::enable(const std::string& path) {
+  this->file = fopen(path.c_str(), "w");
+  if (this->file == nullptr) {
+    fprintf(stderr, "Failed to open file: %s\n", path.c_str());
+    fflush(stderr);
+    exit(EXIT_FAILURE);
+  }
+  this->path = path;
+  this->start_ticks = stats_ticks();
+  this->start_time = std::chrono::steady_clock::now();
+  this->enabled.store(true);
+}
+
+ThreadTrace*
+Tracer::thread_trace() {
+  if (current_trace == nullptr) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    current_trace = new ThreadTrace(this->threads.size() + 1);
+    this->threads.push_back(current_trace);
+  }
+  return current_trace;
+}
+
+void
+Tracer::name_thread(const char* name) {
+  if (this->on()) {
+    this->thread_trace()->name.store(name, std::memory_order_relaxed);
+  }
+}
+
+// events of threads still running are written up to their last complete one
+void
+Tracer::write() {
+  if (this->file == nullptr) {
+    return;
+  }
+  this->enabled.store(false);
+  auto end_ticks = stats_ticks();
+  double elapsed = std::chrono::duration<double, std::micro>(
+                       std::chrono::steady_clock::now() - this->start_time)
+                       .count();
+  double tick_us = 0;
+  if (end_ticks > this->start_ticks) {
+    tick_us = elapsed / (end_ticks - this->start_ticks);
+  }
+  auto file = this->file;
+  std::lock_guard<std::mutex> lock(this->mutex);
+  uint64_t dropped = 0;
+  fprintf(file, "{\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"args\":{\"name\":\"filterx\"}}");
+  for (auto thread : this->threads) {
+    fprintf(file,
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":",
+            thread->tid);
+    write_json_string(file, thread->name.load(std::memory_order_relaxed));
+    fprintf(file, "}}");
+    dropped += thread->dropped.load(std::memory_order_relaxed);
+    auto chunk = thread->first.load(std::memory_order_acquire);
+    for (; chunk != nullptr;
+         chunk = chunk->next.load(std::memory_order_acquire)) {
+      size_t n = chunk->size.load(std::memory_order_acquire);
+      for (size_t i = 0; i < n; i++) {
+        auto& event = chunk->events[i];
+        // events from before --trace was parsed start with the trace
+        uint64_t begin = std::max(event.begin, this->start_ticks);
+        uint64_t end = std::max(event.end, begin);
+        fprintf(file,
+                ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                event.name, event.category, thread->tid,
+                (begin - this->start_ticks) * tick_us,
+                (end - begin) * tick_us);
+        if (event.detail != nullptr || event.arg_name != nullptr) {
+          fprintf(file, ",\"args\":{");
+          if (event.detail != nullptr) {
+            fprintf(file, "\"file\":");
+            write_json_string(file, event.detail);
+          }
+          if (event.arg_name != nullptr) {
+            fprintf(file, "%s\"%s\":%lld", event.detail != nullptr ? "," : "",
+                    event.arg_name, (long long)event.arg);
+          }
+          fprintf(file, "}");
+        }
+        fprintf(file, "}");
+      }
+    }
+  }
+  fprintf(file,
+          "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":"
+          "%llu}}\n",
+          (unsigned long long)dropped);
+  if (fclose(file) != 0) {
+    fprintf(stderr, "Failed to write file: %s\n", this->path.c_str());
+  }
+  this->file = nullptr;
+  if (dropped > 0) {
+    fprintf(stderr, "warning: %llu trace events dropped, at most %zu are "
+                    "kept per thread\n",
+            (unsigned long long)dropped, ThreadTrace::MAX_EVENTS);
+  }
+}
+
+} // namespace filterx
@@ -0,0 +1,258 @@
+#include "vcf.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace filterx {
+
+VcfFields vcf_fields;
+
+static const char* VCF_FIXED_COLUMNS[] = {
+  "CHROM", "POS", "ID", "REF", "ALT", "QUAL", "FILTER", "INFO", "FORMAT",
+};
+
+int
+VcfFields::column(std::string_view name, std::string* error) {
+  if (name.size() > 1 && name.front() == '#') {
+    name.remove_prefix(1);
+  }
+  for (int i = 0; i < VCF_SAMPLE_COLUMN; i++) {
+    if (name == VCF_FIXED_COLUMNS[i]) {
+      return i;
+    }
+  }
+  VcfField field;
+  if (name.substr(0, 5) == "INFO/") {
+    field.kind = VcfFieldInfo;
+    field.key = name.substr(5);
+  } else if (name.substr(0, 7) == "FORMAT/") {
+    auto at = name.find('@');
+    if (at == std::string_view::npos || at + 1 == name.size()) {
+      *error = "FORMAT field needs a sample, like FORMAT/GT@sample";
+      return -1;
+    }
+    field.kind = VcfFieldFormat;
+    field.key = name.substr(7, at - 7);
+    field.sample = name.substr(at + 1);
+  } else {
+    *error = "unknown VCF column " + std::string(name)
+             + ", expect CHROM to FORMAT, INFO/<key> or "
+               "FORMAT/<key>@<sample>";
+    return -1;
+  }
+  if (field.key.empty()) {
+    *error = "VCF field key is empty";
+    return -1;
+  }
+  for (size_t i = 0; i < this->fields.size(); i++) {
+    auto& f = this->fields[i];
+    if (f.kind == field.kind && f.key == field.key
+        && f.sample == field.sample) {
+      return ROW_FIELD_COLUMN + i;
+    }
+  }
+  this->fields.push_back(field);
+  return ROW_FIELD_COLUMN + this->fields.size() - 1;
+}
+
+VcfLayout::VcfLayout(std::vector<uint32_t>& keys, std::vector<int>& columns) {
+  for (auto key : keys) {
+    this->use(key);
+  }
+  for (auto column : columns) {
+    this->use(column);
+  }
+}
+
+void
+VcfLayout::use(int column) {
+  if (column < 0) {
+    return;
+  }
+  if (column < ROW_FIELD_COLUMN) {
+    if (column > this->last_column) {
+      this->last_column = column;
+    }
+    this->update_limit();
+    return;
+  }
+  size_t n = column - ROW_FIELD_COLUMN;
+  if (this->used.size() < vcf_fields.size()) {
+    this->used.resize(vcf_fields.size(), false);
+    this->sample_columns.resize(vcf_fields.size(), -1);
+  }
+  this->used[n] = true;
+  if (vcf_fields.get(n).kind == VcfFieldFormat) {
+    this->has_format = true;
+  }
+  this->update_limit();
+}
+
+void
+VcfLayout::use_all_columns() {
+  this->all_columns = true;
+  this->update_limit();
+}
+
+// the sample columns of FORMAT fields are known after the #CHROM line, rows
+// are split fully until then
+void
+VcfLayout::update_limit() {
+  this->limit = 0;
+  if (this->all_columns || (this->has_format && !this->has_header)) {
+    return;
+  }
+  int last = this->last_column;
+  for (size_t i = 0; i < this->used.size(); i++) {
+    if (!this->used[i]) {
+      continue;
+    }
+    int column = VCF_INFO_COLUMN;
+    if (vcf_fields.get(i).kind == VcfFieldFormat) {
+      column = this->sample_columns[i];
+    }
+    if (column > last) {
+      last = column;
+    }
+  }
+  this->limit = last + 1;
+}
+
+void
+VcfLayout::add_header_line(std::string_view line, const std::string& path) {
+  if (!this->has_format || line.substr(0, 6) != "#CHROM") {
+    return;
+  }
+  std::vector<std::string_view> samples;
+  size_t pos = 0;
+  int column = 0;
+  while (pos <= line.size()) {
+    auto end = line.find('\t', pos);
+    if (end == std::string_view::npos) {
+      end = line.size();
+    }
+    if (column >= VCF_SAMPLE_COLUMN) {
+      auto name = line.substr(pos, end - pos);
+      if (!name.empty() && name.back() == '\r') {
+        name.remove_suffix(1);
+      }
+      samples.push_back(name);
+    }
+    column++;
+    pos = end + 1;
+  }
+  for (size_t i = 0; i < this->used.size(); i++) {
+    auto& field = vcf_fields.get(i);
+    if (!this->used[i] || field.kind != VcfFieldFormat) {
+      continue;
+    }
+    this->sample_columns[i] = -1;
+    for (size_t j = 0; j < samples.size(); j++) {
+      if (samples[j] == field.sample) {
+        this->sample_columns[i] = VCF_SAMPLE_COLUMN + j;
+        break;
+      }
+    }
+    if (this->sample_columns[i] < 0) {
+      fprintf(stderr, "sample %s of FORMAT/%s@%s is not in %s\n",
+              field.sample.c_str(), field.key.c_str(), field.sample.c_str(),
+              path.c_str());
+      exit(EXIT_FAILURE);
+    }
+  }
+  this->has_header = true;
+  this->update_limit();
+}
+
+// value of key in the INFO column, "1" for a flag
+static std::string_view
+info_value(std::string_view info, std::string_view key) {
+  size_t pos = 0;
+  while (pos < info.size()) {
+    auto end = info.find(';', pos);
+    if (end == std::string_view::npos) {
+      end = info.size();
+    }
+    auto entry = info.substr(pos, end - pos);
+    if (entry.size() >= key.size() && entry.compare(0, key.size(), key) == 0) {
+      if (entry.size() == key.size()) {
+        return "1";
+      }
+      if (entry[key.size()] == '=') {
+        return entry.substr(key.size() + 1);
+      }
+    }
+    pos = end + 1;
+  }
+  return std::string_view();
+}
+
+// value of key in a sample column, the sub-fields of the sample are walked
+// up to the position of key in the FORMAT column only
+static std::string_view
+format_value(std::string_view format, std::string_view sample,
+             std::string_view key) {
+  size_t pos = 0;
+  int index = 0;
+  while (1) {
+    auto end = format.find(':', pos);
+    if (end == std::string_view::npos) {
+      end = format.size();
+    }
+    if (format.substr(pos, end - pos) == key) {
+      break;
+    }
+    if (end == format.size()) {
+      return std::string_view();
+    }
+    pos = end + 1;
+    index++;
+  }
+  pos = 0;
+  for (; index > 0; index--) {
+    pos = sample.find(':', pos);
+    if (pos == std::string_view::npos) {
+      return std::string_view();
+    }
+    pos++;
+  }
+  auto end = sample.find(':', pos);
+  if (end == std::string_view::npos) {
+    end = sample.size();
+  }
+  return sample.substr(pos, end - pos);
+}
+
+void
+VcfLayout::extract(Row* row) {
+  for (size_t i = 0; i < this->used.size(); i++) {
+    std::string_view value;
+    if (this->used[i]) {
+      auto& field = vcf_fields.get(i);
+      if (field.kind == VcfFieldInfo) {
+        auto info = row->get_item(VCF_INFO_COLUMN);
+        if (info.has_value()) {
+          value = info_value(info.value(), field.key);
+        }
+      } else {
+        if (!this->has_header) {
+          fprintf(stderr, "FORMAT/%s@%s needs the #CHROM header line\n",
+                  field.key.c_str(), field.sample.c_str());
+          exit(EXIT_FAILURE);
+        }
+        auto format = row->get_item(VCF_FORMAT_COLUMN);
+        auto sample = row->get_item(this->sample_columns[i]);
+        if (format.has_value() && sample.has_value()) {
+          value = format_value(format.value(), sample.value(), field.key);
+        }
+      }
+      // a missing value is a missing item
+      if (value == ".") {
+        value = std::string_view();
+      }
+    }
+    row->add_field(value);
+  }
+}
+
+} // namespace filterx
@@ -0,0 +1,113 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "generator.h"
+
+using namespace filterx::tools;
+
+static void
+usage() {
+  fprintf(stderr, "Usage: filterx-gen [options] <prefix>\n");
+  fprintf(stderr, "Writes sorted input files <prefix>.1.<ext> .. "
+                  "<prefix>.<n>.<ext>.\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --shape [vcf|blast|csv]     vcf has CHROM and POS keys "
+                  "and wide rows, blast\n"
+                  "                              has many rows per key, "
+                  "default is csv\n");
+  fprintf(stderr, "  --rows <n>                  Rows of every file, default "
+                  "is 100000\n");
+  fprintf(stderr, "  --files <n>                 Number of files, default is "
+                  "2\n");
+  fprintf(stderr, "  --overlap <ratio>           Share of the keys found in "
+                  "every file, the others\n"
+                  "                              are in one file only, "
+                  "default is 0.5\n");
+  fprintf(stderr, "  --group-size <n>            Mean rows of a key in a "
+                  "file, default is 20 for\n"
+                  "                              blast and 1 otherwise\n");
+  fprintf(stderr, "  --group-dist [fixed|uniform|geometric]\n"
+                  "                              Distribution of the rows of "
+                  "a key, default is fixed\n");
+  fprintf(stderr, "  --compress [none|gzip|bgzf] Default is none\n");
+  fprintf(stderr, "  --samples <n>               Sample columns of vcf rows, "
+                  "default is 10\n");
+  fprintf(stderr, "  --seed <n>                  Default is 1\n");
+  fprintf(stderr, "  -h, --help                  Show this help message\n");
+  fprintf(stderr, "The filterx arguments that read the files are printed.\n");
+}
+
+static const char*
+value(int argc, char** argv, int* i) {
+  if (*i + 1 >= argc) {
+    fprintf(stderr, "missing value of %s\n", argv[*i]);
+    exit(EXIT_FAILURE);
+  }
+  return argv[++*i];
+}
+
+int
+main(int argc, char** argv) {
+  GenParams params;
+  const char* prefix = nullptr;
+  for (int i = 1; i < argc; i++) {
+    auto arg = argv[i];
+    if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+      usage();
+      return 0;
+    }
+    if (strcmp(arg, "--shape") == 0) {
+      if (!parse_shape(value(argc, argv, &i), &params.shape)) {
+        fprintf(stderr, "unknown shape: %s\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(arg, "--rows") == 0) {
+      params.rows = strtoull(value(argc, argv, &i), nullptr, 10);
+    } else if (strcmp(arg, "--files") == 0) {
+      params.files = atoi(value(argc, argv, &i));
+    } else if (strcmp(arg, "--overlap") == 0) {
+      params.overlap = atof(value(argc, argv, &i));
+    } else if (strcmp(arg, "--group-size") == 0) {
+      params.group_size = atof(value(argc, argv, &i));
+    } else if (strcmp(arg, "--group-dist") == 0) {
+      if (!parse_group_dist(value(argc, argv, &i), &params.group_dist)) {
+        fprintf(stderr, "unknown group distribution: %s\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(arg, "--compress") == 0) {
+      if (!parse_compress(value(argc, argv, &i), &params.compress)) {
+        fprintf(stderr, "unknown compression: %s\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(arg, "--samples") == 0) {
+      params.samples = atoi(value(argc, argv, &i));
+    } else if (strcmp(arg, "--seed") == 0) {
+      params.seed = strtoull(value(argc, argv, &i), nullptr, 10);
+    } else if (arg[0] == '-') {
+      fprintf(stderr, "unknown option: %s\n", arg);
+      usage();
+      return EXIT_FAILURE;
+    } else if (prefix == nullptr) {
+      prefix = arg;
+    } else {
+      fprintf(stderr, "more than one prefix: %s\n", arg);
+      return EXIT_FAILURE;
+    }
+  }
+  if (prefix == nullptr) {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  auto paths = generate(params, prefix);
+  printf("filterx");
+  for (auto& arg : shape_filterx_args(params.shape)) {
+    printf(" %s", arg.c_str());
+  }
+  for (auto& path : paths) {
+    printf(" %s", path.c_str());
+  }
+  printf("\n");
+  return 0;
+}
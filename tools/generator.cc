@@ -0,0 +1,458 @@
+#include "generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "zlib.h"
+
+namespace filterx {
+namespace tools {
+
+static const char* SHAPE_NAMES[] = { "vcf", "blast", "csv" };
+static const char* COMPRESS_NAMES[] = { "none", "gzip", "bgzf" };
+static const char* GROUP_DIST_NAMES[] = { "fixed", "uniform", "geometric" };
+
+// bgzip keeps the input of a block below 64K, so the compressed block fits
+static const size_t BGZF_BLOCK_INPUT = 0xff00;
+static const size_t BGZF_BLOCK_SIZE = 0x10000;
+static const size_t BGZF_HEADER_SIZE = 18;
+static const size_t BGZF_FOOTER_SIZE = 8;
+static const unsigned char BGZF_EOF[] = { 0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00,
+                                          0x00, 0x00, 0x00, 0xff, 0x06, 0x00,
+                                          0x42, 0x43, 0x02, 0x00, 0x1b, 0x00,
+                                          0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                          0x00, 0x00, 0x00, 0x00 };
+
+static const size_t FLUSH_SIZE = 1 << 20;
+
+template <typename T>
+static bool
+parse_name(const char* text, const char* const* names, int n, T* value) {
+  for (int i = 0; i < n; i++) {
+    if (strcmp(text, names[i]) == 0) {
+      *value = static_cast<T>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+parse_shape(const char* text, GenShape* shape) {
+  return parse_name(text, SHAPE_NAMES, 3, shape);
+}
+
+bool
+parse_compress(const char* text, GenCompress* compress) {
+  return parse_name(text, COMPRESS_NAMES, 3, compress);
+}
+
+bool
+parse_group_dist(const char* text, GenGroupDist* dist) {
+  return parse_name(text, GROUP_DIST_NAMES, 3, dist);
+}
+
+const char*
+shape_name(GenShape shape) {
+  return SHAPE_NAMES[shape];
+}
+
+const char*
+compress_name(GenCompress compress) {
+  return COMPRESS_NAMES[compress];
+}
+
+std::vector<std::string>
+shape_filterx_args(GenShape shape) {
+  switch (shape) {
+  case GenShapeVcf:
+    return { "-1", "k=1s2i" };
+  case GenShapeBlast:
+    return { "-1", "k=1s" };
+  case GenShapeCsv:
+    return { "-1", "k=1s:s=," };
+  }
+  return {};
+}
+
+static double
+default_group_size(GenShape shape) {
+  return shape == GenShapeBlast ? 20 : 1;
+}
+
+// one output file, rows are buffered and written in large blocks
+class GenFile {
+public:
+  GenFile(const std::string& path, GenCompress compress)
+      : path(path), compress(compress) {
+    if (compress == GenCompressGzip) {
+      this->gz = gzopen(path.c_str(), "wb6");
+      if (this->gz == nullptr) {
+        this->fail("open");
+      }
+    } else {
+      this->file = fopen(path.c_str(), "wb");
+      if (this->file == nullptr) {
+        this->fail("open");
+      }
+    }
+    if (compress == GenCompressBgzf) {
+      memset(&this->stream, 0, sizeof(this->stream));
+      if (deflateInit2(&this->stream, 6, Z_DEFLATED, -15, 8,
+                       Z_DEFAULT_STRATEGY)
+          != Z_OK) {
+        this->fail("compress");
+      }
+      this->block.resize(BGZF_BLOCK_SIZE);
+    }
+  }
+
+  ~GenFile() { this->close(); }
+
+  std::string&
+  buffer() {
+    return this->data;
+  }
+
+  void
+  row_done() {
+    this->rows++;
+    if (this->data.size() >= FLUSH_SIZE) {
+      this->flush(false);
+    }
+  }
+
+  void
+  close() {
+    if (this->file == nullptr && this->gz == nullptr) {
+      return;
+    }
+    this->flush(true);
+    if (this->gz != nullptr) {
+      if (gzclose(this->gz) != Z_OK) {
+        this->fail("write");
+      }
+      this->gz = nullptr;
+      return;
+    }
+    if (this->compress == GenCompressBgzf) {
+      fwrite(BGZF_EOF, 1, sizeof(BGZF_EOF), this->file);
+      deflateEnd(&this->stream);
+    }
+    if (fclose(this->file) != 0) {
+      this->file = nullptr;
+      this->fail("write");
+    }
+    this->file = nullptr;
+  }
+
+  uint64_t rows = 0;
+
+private:
+  [[noreturn]] void
+  fail(const char* what) {
+    fprintf(stderr, "Failed to %s file: %s\n", what, this->path.c_str());
+    exit(EXIT_FAILURE);
+  }
+
+  // a partial bgzf block is kept for the next flush until the end
+  void
+  flush(bool end) {
+    if (this->compress == GenCompressGzip) {
+      if (!this->data.empty()
+          && gzwrite(this->gz, this->data.data(), this->data.size()) == 0) {
+        this->fail("write");
+      }
+      this->data.clear();
+      return;
+    }
+    if (this->compress == GenCompressNone) {
+      if (fwrite(this->data.data(), 1, this->data.size(), this->file)
+          != this->data.size()) {
+        this->fail("write");
+      }
+      this->data.clear();
+      return;
+    }
+    size_t offset = 0;
+    while (this->data.size() - offset >= BGZF_BLOCK_INPUT
+           || (end && offset < this->data.size())) {
+      size_t n = std::min(BGZF_BLOCK_INPUT, this->data.size() - offset);
+      this->write_block(this->data.data() + offset, n);
+      offset += n;
+    }
+    this->data.erase(0, offset);
+  }
+
+  void
+  write_block(const char* input, size_t size) {
+    auto out = this->block.data();
+    deflateReset(&this->stream);
+    this->stream.next_in = (Bytef*)input;
+    this->stream.avail_in = size;
+    this->stream.next_out = out + BGZF_HEADER_SIZE;
+    this->stream.avail_out
+        = BGZF_BLOCK_SIZE - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+    if (deflate(&this->stream, Z_FINISH) != Z_STREAM_END) {
+      this->fail("compress");
+    }
+    size_t block_size
+        = BGZF_HEADER_SIZE + this->stream.total_out + BGZF_FOOTER_SIZE;
+    static const unsigned char header[] = { 0x1f, 0x8b, 0x08, 0x04, 0, 0,
+                                            0,    0,    0,    0xff, 6, 0,
+                                            'B',  'C',  2,    0 };
+    memcpy(out, header, sizeof(header));
+    out[16] = (block_size - 1) & 0xff;
+    out[17] = (block_size - 1) >> 8;
+    uint32_t crc = crc32(0, (const Bytef*)input, size);
+    auto footer = out + block_size - BGZF_FOOTER_SIZE;
+    for (int i = 0; i < 4; i++) {
+      footer[i] = (crc >> (8 * i)) & 0xff;
+      footer[4 + i] = (size >> (8 * i)) & 0xff;
+    }
+    if (fwrite(out, 1, block_size, this->file) != block_size) {
+      this->fail("write");
+    }
+  }
+
+  std::string path;
+  GenCompress compress;
+  FILE* file = nullptr;
+  gzFile gz = nullptr;
+  z_stream stream;
+  std::vector<unsigned char> block;
+  std::string data;
+};
+
+static void
+append_uint(std::string& out, uint64_t value) {
+  char digits[24];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  while (n > 0) {
+    out.push_back(digits[--n]);
+  }
+}
+
+// zero padded, so the keys sort the same way as strings and as numbers
+static void
+append_padded(std::string& out, uint64_t value, int width) {
+  char digits[24];
+  int n = snprintf(digits, sizeof(digits), "%0*llu", width,
+                   (unsigned long long)value);
+  out.append(digits, n);
+}
+
+class RowWriter {
+public:
+  RowWriter(const GenParams& params, uint64_t keys_per_chrom)
+      : params(params), random(params.seed * 7919 + 17),
+        keys_per_chrom(keys_per_chrom) {
+    for (int i = 1; i <= 22; i++) {
+      this->chroms.push_back("chr" + std::to_string(i));
+    }
+    // the key is k=1s2i, so chromosomes sort as strings
+    std::sort(this->chroms.begin(), this->chroms.end());
+  }
+
+  void
+  header(GenFile& file) {
+    auto& out = file.buffer();
+    if (this->params.shape == GenShapeVcf) {
+      out.append("##fileformat=VCFv4.2\n##source=filterx-gen\n"
+                 "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT");
+      for (int i = 0; i < this->params.samples; i++) {
+        out.append("\tS");
+        append_uint(out, i + 1);
+      }
+      out.push_back('\n');
+    } else if (this->params.shape == GenShapeCsv) {
+      out.append("#key,count,score,start,end\n");
+    }
+  }
+
+  void
+  row(GenFile& file, uint64_t key, uint64_t index) {
+    switch (this->params.shape) {
+    case GenShapeVcf:
+      this->vcf_row(file.buffer(), key, index);
+      break;
+    case GenShapeBlast:
+      this->blast_row(file.buffer(), key);
+      break;
+    case GenShapeCsv:
+      this->csv_row(file.buffer(), key);
+      break;
+    }
+    file.row_done();
+  }
+
+private:
+  void
+  vcf_row(std::string& out, uint64_t key, uint64_t index) {
+    static const char* BASES = "ACGT";
+    static const char* GENOTYPES[] = { "0|0", "0|1", "1|0", "1|1" };
+    uint64_t chrom = std::min<uint64_t>(key / this->keys_per_chrom, 21);
+    uint64_t pos = (key - chrom * this->keys_per_chrom) * 10 + 100;
+    out.append(this->chroms[chrom]);
+    out.push_back('\t');
+    append_uint(out, pos);
+    out.append("\trs");
+    append_uint(out, key);
+    out.push_back('\t');
+    int ref = this->random() % 4;
+    out.push_back(BASES[ref]);
+    out.push_back('\t');
+    // rows of a group are the alleles of a multiallelic site
+    out.push_back(BASES[(ref + 1 + index % 3) % 4]);
+    out.push_back('\t');
+    append_uint(out, this->random() % 1000);
+    out.append("\tPASS\tDP=");
+    append_uint(out, this->random() % 500);
+    out.append(";AF=0.");
+    append_padded(out, this->random() % 1000, 3);
+    out.append("\tGT:DP");
+    for (int i = 0; i < this->params.samples; i++) {
+      out.push_back('\t');
+      out.append(GENOTYPES[this->random() % 4]);
+      out.push_back(':');
+      append_uint(out, this->random() % 60);
+    }
+    out.push_back('\n');
+  }
+
+  void
+  blast_row(std::string& out, uint64_t key) {
+    out.push_back('q');
+    append_padded(out, key, 10);
+    out.append("\ts");
+    append_padded(out, this->random() % 100000000, 8);
+    out.push_back('\t');
+    uint64_t pident = 500 + this->random() % 501;
+    append_uint(out, pident / 10);
+    out.push_back('.');
+    append_uint(out, pident % 10);
+    uint64_t length = 50 + this->random() % 950;
+    uint64_t start = 1 + this->random() % 5000;
+    uint64_t sstart = 1 + this->random() % 100000;
+    for (auto value :
+         { length, length * (1000 - pident) / 1000, this->random() % 5, start,
+           start + length - 1, sstart, sstart + length - 1 }) {
+      out.push_back('\t');
+      append_uint(out, value);
+    }
+    out.append("\t1e-");
+    append_uint(out, 5 + this->random() % 150);
+    out.push_back('\t');
+    append_uint(out, length * pident / 500);
+    out.push_back('\n');
+  }
+
+  void
+  csv_row(std::string& out, uint64_t key) {
+    out.push_back('k');
+    append_padded(out, key, 10);
+    for (int i = 0; i < 4; i++) {
+      out.push_back(',');
+      append_uint(out, this->random() % 1000000);
+    }
+    out.push_back('\n');
+  }
+
+  const GenParams& params;
+  std::mt19937_64 random;
+  uint64_t keys_per_chrom;
+  std::vector<std::string> chroms;
+};
+
+std::vector<std::string>
+generate(GenParams params, const std::string& prefix) {
+  if (params.files < 1) {
+    fprintf(stderr, "files should be at least 1\n");
+    exit(EXIT_FAILURE);
+  }
+  if (params.group_size <= 0) {
+    params.group_size = default_group_size(params.shape);
+  }
+  params.group_size = std::max(1.0, params.group_size);
+  params.overlap = std::min(1.0, std::max(0.0, params.overlap));
+
+  const char* extension = params.shape == GenShapeVcf     ? ".vcf"
+                          : params.shape == GenShapeBlast ? ".tsv"
+                                                          : ".csv";
+  std::vector<std::string> paths;
+  std::vector<GenFile*> files;
+  for (int i = 0; i < params.files; i++) {
+    auto path = prefix + "." + std::to_string(i + 1) + extension;
+    if (params.compress != GenCompressNone) {
+      path += ".gz";
+    }
+    paths.push_back(path);
+    files.push_back(new GenFile(path, params.compress));
+  }
+
+  // rows of a file per key on average, to spread keys over 22 chromosomes
+  double key_rows
+      = params.group_size
+        * (params.overlap + (1 - params.overlap) / params.files);
+  uint64_t keys_per_chrom
+      = std::max<uint64_t>(1, std::ceil(params.rows / key_rows / 22));
+  RowWriter writer(params, keys_per_chrom);
+  for (auto file : files) {
+    writer.header(*file);
+  }
+
+  std::mt19937_64 random(params.seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::uniform_int_distribution<uint64_t> uniform(
+      1, std::max<uint64_t>(1, std::llround(2 * params.group_size - 1)));
+  std::geometric_distribution<uint64_t> geometric(1 / params.group_size);
+  auto group_size = [&]() -> uint64_t {
+    switch (params.group_dist) {
+    case GenGroupDistUniform:
+      return uniform(random);
+    case GenGroupDistGeometric:
+      return 1 + geometric(random);
+    default:
+      return std::max<uint64_t>(1, std::llround(params.group_size));
+    }
+  };
+  auto add_group = [&](GenFile* file, uint64_t key) {
+    uint64_t n = std::min(group_size(), params.rows - file->rows);
+    for (uint64_t i = 0; i < n; i++) {
+      writer.row(*file, key, i);
+    }
+  };
+
+  // files still short of rows
+  std::vector<GenFile*> open(files);
+  for (uint64_t key = 0; !open.empty(); key++) {
+    if (open.size() > 1 && unit(random) >= params.overlap) {
+      add_group(open[random() % open.size()], key);
+    } else {
+      for (auto file : open) {
+        add_group(file, key);
+      }
+    }
+    open.erase(std::remove_if(open.begin(), open.end(),
+                              [&](GenFile* file) {
+                                return file->rows >= params.rows;
+                              }),
+               open.end());
+  }
+  for (auto file : files) {
+    file->close();
+    delete file;
+  }
+  return paths;
+}
+
+} // namespace tools
+} // namespace filterx
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace filterx {
+namespace tools {
+
+enum GenShape {
+  // CHROM and POS keys, wide rows with sample columns
+  GenShapeVcf = 0,
+  // one query key with many hits per key
+  GenShapeBlast = 1,
+  // one key, a few comma separated columns
+  GenShapeCsv = 2,
+};
+
+enum GenCompress {
+  GenCompressNone = 0,
+  GenCompressGzip = 1,
+  // blocked gzip as written by bgzip, a gzip member per 64K block
+  GenCompressBgzf = 2,
+};
+
+enum GenGroupDist {
+  GenGroupDistFixed = 0,
+  // 1 .. 2 * group_size - 1
+  GenGroupDistUniform = 1,
+  // many small groups and a few large ones
+  GenGroupDistGeometric = 2,
+};
+
+struct GenParams {
+  GenShape shape = GenShapeCsv;
+  // rows of every file
+  uint64_t rows = 100000;
+  int files = 2;
+  // share of the keys found in every file, the others are in one file only
+  double overlap = 0.5;
+  // mean rows of a key in a file, 0 for the default of the shape
+  double group_size = 0;
+  GenGroupDist group_dist = GenGroupDistFixed;
+  GenCompress compress = GenCompressNone;
+  // sample columns of vcf rows
+  int samples = 10;
+  uint64_t seed = 1;
+};
+
+// writes params.files files sorted by the key of the shape, named
+// <prefix>.<n>.<extension>, and returns their paths
+std::vector<std::string> generate(GenParams params, const std::string& prefix);
+
+// filterx arguments that read the files of a shape, e.g. -1 k=1s2i
+std::vector<std::string> shape_filterx_args(GenShape shape);
+
+bool parse_shape(const char* text, GenShape* shape);
+bool parse_compress(const char* text, GenCompress* compress);
+bool parse_group_dist(const char* text, GenGroupDist* dist);
+const char* shape_name(GenShape shape);
+const char* compress_name(GenCompress compress);
+
+} // namespace tools
+} // namespace filterx
@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "generator.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace filterx::tools;
+
+struct HarnessOptions {
+  std::string filterx;
+  std::vector<GenShape> shapes{ GenShapeVcf, GenShapeBlast, GenShapeCsv };
+  std::vector<GenCompress> compressions{ GenCompressNone };
+  std::vector<uint64_t> rows{ 10000, 100000 };
+  std::vector<int> files{ 1, 2, 4, 8 };
+  GenParams gen;
+  int repeat = 3;
+  std::vector<std::string> args;
+  std::string csv;
+  std::string dir;
+};
+
+struct RunResult {
+  double seconds = 0;
+  // of the fastest run, in bytes
+  uint64_t max_rss = 0;
+};
+
+// removes generated inputs at exit unless --dir is given
+struct ScratchDir {
+  std::string path;
+
+  ~ScratchDir() {
+    if (!this->path.empty()) {
+      std::error_code error;
+      std::filesystem::remove_all(this->path, error);
+    }
+  }
+};
+
+static ScratchDir scratch;
+
+static void
+usage() {
+  fprintf(stderr, "Usage: filterx-harness [options]\n");
+  fprintf(stderr, "Generates sorted inputs and runs filterx over 1..N of "
+                  "them for every shape,\n"
+                  "compression and size, reporting throughput and peak "
+                  "RSS.\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --filterx <path>      The filterx binary, default is "
+                  "the one next to\n"
+                  "                        filterx-harness\n");
+  fprintf(stderr, "  --shape <list>        Shapes among vcf, blast and csv, "
+                  "default is all\n");
+  fprintf(stderr, "  --compress <list>     Among none, gzip and bgzf, default "
+                  "is none\n");
+  fprintf(stderr, "  --rows <list>         Rows of every file, default is "
+                  "10000,100000\n");
+  fprintf(stderr, "  --files <list>        File counts, default is "
+                  "1,2,4,8\n");
+  fprintf(stderr, "  --overlap <ratio>     Share of the keys found in every "
+                  "file, default is 0.5\n");
+  fprintf(stderr, "  --group-size <n>      Mean rows of a key in a file, "
+                  "default is 20 for blast\n"
+                  "                        and 1 otherwise\n");
+  fprintf(stderr, "  --group-dist <dist>   fixed, uniform or geometric, "
+                  "default is fixed\n");
+  fprintf(stderr, "  --repeat <n>          Runs of every case, the fastest "
+                  "counts, default is 3\n");
+  fprintf(stderr, "  --args <args>         More filterx arguments, split on "
+                  "spaces, e.g. \"-t 4\"\n");
+  fprintf(stderr, "  --csv <file>          Also write the results as CSV\n");
+  fprintf(stderr, "  --dir <dir>           Keep the generated inputs in "
+                  "<dir>\n");
+  fprintf(stderr, "  -h, --help            Show this help message\n");
+  fprintf(stderr, "MB/s is of the input files as stored, rel is ns/row "
+                  "relative to the first file\n"
+                  "count, so 1.00 all the way down is linear scaling.\n");
+}
+
+static std::vector<std::string>
+split(const char* text, char separator) {
+  std::vector<std::string> parts;
+  std::string part;
+  for (auto p = text;; p++) {
+    if (*p == separator || *p == '\0') {
+      if (!part.empty()) {
+        parts.push_back(part);
+      }
+      part.clear();
+      if (*p == '\0') {
+        break;
+      }
+    } else {
+      part.push_back(*p);
+    }
+  }
+  return parts;
+}
+
+static const char*
+value(int argc, char** argv, int* i) {
+  if (*i + 1 >= argc) {
+    fprintf(stderr, "missing value of %s\n", argv[*i]);
+    exit(EXIT_FAILURE);
+  }
+  return argv[++*i];
+}
+
+static void
+parse_args(int argc, char** argv, HarnessOptions* options) {
+  for (int i = 1; i < argc; i++) {
+    auto arg = argv[i];
+    if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+      usage();
+      exit(0);
+    }
+    if (strcmp(arg, "--filterx") == 0) {
+      options->filterx = value(argc, argv, &i);
+    } else if (strcmp(arg, "--shape") == 0) {
+      options->shapes.clear();
+      for (auto& name : split(value(argc, argv, &i), ',')) {
+        GenShape shape;
+        if (!parse_shape(name.c_str(), &shape)) {
+          fprintf(stderr, "unknown shape: %s\n", name.c_str());
+          exit(EXIT_FAILURE);
+        }
+        options->shapes.push_back(shape);
+      }
+    } else if (strcmp(arg, "--compress") == 0) {
+      options->compressions.clear();
+      for (auto& name : split(value(argc, argv, &i), ',')) {
+        GenCompress compress;
+        if (!parse_compress(name.c_str(), &compress)) {
+          fprintf(stderr, "unknown compression: %s\n", name.c_str());
+          exit(EXIT_FAILURE);
+        }
+        options->compressions.push_back(compress);
+      }
+    } else if (strcmp(arg, "--rows") == 0) {
+      options->rows.clear();
+      for (auto& n : split(value(argc, argv, &i), ',')) {
+        options->rows.push_back(strtoull(n.c_str(), nullptr, 10));
+      }
+    } else if (strcmp(arg, "--files") == 0) {
+      options->files.clear();
+      for (auto& n : split(value(argc, argv, &i), ',')) {
+        options->files.push_back(std::max(1, atoi(n.c_str())));
+      }
+    } else if (strcmp(arg, "--overlap") == 0) {
+      options->gen.overlap = atof(value(argc, argv, &i));
+    } else if (strcmp(arg, "--group-size") == 0) {
+      options->gen.group_size = atof(value(argc, argv, &i));
+    } else if (strcmp(arg, "--group-dist") == 0) {
+      if (!parse_group_dist(value(argc, argv, &i),
+                            &options->gen.group_dist)) {
+        fprintf(stderr, "unknown group distribution: %s\n", argv[i]);
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(arg, "--repeat") == 0) {
+      options->repeat = std::max(1, atoi(value(argc, argv, &i)));
+    } else if (strcmp(arg, "--args") == 0) {
+      for (auto& part : split(value(argc, argv, &i), ' ')) {
+        options->args.push_back(part);
+      }
+    } else if (strcmp(arg, "--csv") == 0) {
+      options->csv = value(argc, argv, &i);
+    } else if (strcmp(arg, "--dir") == 0) {
+      options->dir = value(argc, argv, &i);
+    } else {
+      fprintf(stderr, "unknown option: %s\n", arg);
+      usage();
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (options->shapes.empty() || options->compressions.empty()
+      || options->rows.empty() || options->files.empty()) {
+    fprintf(stderr, "empty list of cases\n");
+    exit(EXIT_FAILURE);
+  }
+  std::sort(options->files.begin(), options->files.end());
+}
+
+static std::string
+default_filterx(const char* argv0) {
+  std::filesystem::path self(argv0);
+  auto sibling = self.parent_path() / "filterx";
+  std::error_code error;
+  if (self.has_parent_path() && std::filesystem::exists(sibling, error)) {
+    return sibling.string();
+  }
+  // looked up in PATH
+  return "filterx";
+}
+
+static std::string
+data_dir(const HarnessOptions& options) {
+  std::error_code error;
+  if (!options.dir.empty()) {
+    std::filesystem::create_directories(options.dir, error);
+    return options.dir;
+  }
+  std::random_device random;
+  char name[64];
+  snprintf(name, sizeof(name), "filterx-harness-%08x", random());
+  auto path = std::filesystem::temp_directory_path() / name;
+  if (!std::filesystem::create_directories(path, error)) {
+    fprintf(stderr, "Failed to create directory: %s\n",
+            path.string().c_str());
+    exit(EXIT_FAILURE);
+  }
+  scratch.path = path.string();
+  return scratch.path;
+}
+
+#ifdef _WIN32
+static RunResult
+run_filterx(const std::vector<std::string>&, const std::string&) {
+  fprintf(stderr, "filterx-harness is not supported on Windows\n");
+  exit(EXIT_FAILURE);
+}
+#else
+// the output goes to the null device, stderr to a file shown on failure
+static RunResult
+run_filterx(const std::vector<std::string>& args,
+            const std::string& error_path) {
+  std::vector<char*> argv;
+  for (auto& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid < 0) {
+    fprintf(stderr, "Failed to start filterx\n");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    int error = open(error_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (null < 0 || error < 0) {
+      _exit(127);
+    }
+    dup2(null, STDOUT_FILENO);
+    dup2(error, STDERR_FILENO);
+    execvp(argv[0], argv.data());
+    fprintf(stderr, "Failed to run %s\n", argv[0]);
+    _exit(127);
+  }
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0) {
+    fprintf(stderr, "Failed to wait for filterx\n");
+    exit(EXIT_FAILURE);
+  }
+  RunResult result;
+  result.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "filterx failed:");
+    for (auto& arg : args) {
+      fprintf(stderr, " %s", arg.c_str());
+    }
+    fprintf(stderr, "\n");
+    FILE* file = fopen(error_path.c_str(), "r");
+    if (file != nullptr) {
+      char line[4096];
+      while (fgets(line, sizeof(line), file) != nullptr) {
+        fputs(line, stderr);
+      }
+      fclose(file);
+    }
+    exit(EXIT_FAILURE);
+  }
+#ifdef __APPLE__
+  result.max_rss = usage.ru_maxrss;
+#else
+  result.max_rss = (uint64_t)usage.ru_maxrss * 1024;
+#endif
+  return result;
+}
+#endif
+
+int
+main(int argc, char** argv) {
+  HarnessOptions options;
+  parse_args(argc, argv, &options);
+  if (options.filterx.empty()) {
+    options.filterx = default_filterx(argv[0]);
+  }
+  auto dir = data_dir(options);
+  auto error_path = (std::filesystem::path(dir) / "filterx.err").string();
+
+  FILE* csv = nullptr;
+  if (!options.csv.empty()) {
+    csv = fopen(options.csv.c_str(), "w");
+    if (csv == nullptr) {
+      fprintf(stderr, "Failed to open file: %s\n", options.csv.c_str());
+      return EXIT_FAILURE;
+    }
+    fprintf(csv, "shape,compress,rows_per_file,files,input_bytes,seconds,"
+                 "mb_per_s,rows_per_s,ns_per_row,max_rss_bytes\n");
+  }
+  printf("%-6s %-5s %10s %5s %10s %9s %8s %9s %8s %5s %10s\n", "shape",
+         "comp", "rows/file", "files", "input_MB", "seconds", "MB/s",
+         "Mrows/s", "ns/row", "rel", "max_rss_MB");
+  fflush(stdout);
+
+  int max_files = options.files.back();
+  for (auto shape : options.shapes) {
+    for (auto compress : options.compressions) {
+      for (auto rows : options.rows) {
+        auto params = options.gen;
+        params.shape = shape;
+        params.compress = compress;
+        params.rows = rows;
+        params.files = max_files;
+        char name[128];
+        snprintf(name, sizeof(name), "%s-%s-%llu", shape_name(shape),
+                 compress_name(compress), (unsigned long long)rows);
+        // the cases of fewer files take the first files of the largest one
+        auto paths
+            = generate(params, (std::filesystem::path(dir) / name).string());
+        double first_ns = 0;
+        for (int nfiles : options.files) {
+          std::vector<std::string> args{ options.filterx };
+          for (auto& arg : shape_filterx_args(shape)) {
+            args.push_back(arg);
+          }
+          args.insert(args.end(), options.args.begin(), options.args.end());
+          uint64_t bytes = 0;
+          for (int i = 0; i < nfiles; i++) {
+            args.push_back(paths[i]);
+            bytes += std::filesystem::file_size(paths[i]);
+          }
+          RunResult best;
+          for (int i = 0; i < options.repeat; i++) {
+            auto result = run_filterx(args, error_path);
+            if (i == 0 || result.seconds < best.seconds) {
+              best = result;
+            }
+          }
+          double total_rows = 1.0 * rows * nfiles;
+          double seconds = std::max(best.seconds, 1e-9);
+          double ns = seconds * 1e9 / total_rows;
+          if (first_ns == 0) {
+            first_ns = ns;
+          }
+          printf("%-6s %-5s %10llu %5d %10.2f %9.3f %8.1f %9.2f %8.1f %5.2f "
+                 "%10.1f\n",
+                 shape_name(shape), compress_name(compress),
+                 (unsigned long long)rows, nfiles, bytes / 1e6, seconds,
+                 bytes / 1e6 / seconds, total_rows / 1e6 / seconds, ns,
+                 ns / first_ns, best.max_rss / 1e6);
+          fflush(stdout);
+          if (csv != nullptr) {
+            fprintf(csv, "%s,%s,%llu,%d,%llu,%.6f,%.3f,%.1f,%.2f,%llu\n",
+                    shape_name(shape), compress_name(compress),
+                    (unsigned long long)rows, nfiles,
+                    (unsigned long long)bytes, seconds, bytes / 1e6 / seconds,
+                    total_rows / seconds, ns,
+                    (unsigned long long)best.max_rss);
+          }
+        }
+        // inputs of one size at a time are kept on disk
+        if (options.dir.empty()) {
+          for (auto& path : paths) {
+            std::error_code error;
+            std::filesystem::remove(path, error);
+          }
+        }
+      }
+    }
+  }
+  if (csv != nullptr && fclose(csv) != 0) {
+    fprintf(stderr, "Failed to write file: %s\n", options.csv.c_str());
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
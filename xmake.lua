@@ -1,5 +1,12 @@
 add_rules("mode.debug", "mode.release")
 
+-- count heap allocations per stage in --stats, xmake f --alloc-stats=y
+option("alloc-stats")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Count operator new calls per stage")
+    add_defines("FILTERX_ALLOC_STATS")
+
 target("zlib")
     set_kind("static")
     add_includedirs("deps/zlib")
@@ -16,4 +23,45 @@ target("filterx")
     add_includedirs("include", "deps/zlib")
     add_files("src/*.cc")
     add_deps("zlib")
+    add_options("alloc-stats")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
+    add_cxxflags("-std=c++17")
+
+-- microbenchmarks of the parsing and merge paths, xmake run filterx-bench
+target("filterx-bench")
+    set_kind("binary")
+    set_default(false)
+    add_includedirs("include", "bench", "deps/zlib")
+    add_files("src/*.cc|main.cc", "bench/*.cc")
+    add_deps("zlib")
+    add_options("alloc-stats")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
+    add_cxxflags("-std=c++17")
+    -- with --alloc-stats=y, a merge that allocates per row fails the build
+    after_build(function (target)
+        if has_config("alloc-stats") then
+            os.execv(target:targetfile(), {"--check-allocs"})
+        end
+    end)
+
+-- sorted input generator, xmake run filterx-gen --help
+target("filterx-gen")
+    set_kind("binary")
+    set_default(false)
+    add_includedirs("tools", "deps/zlib")
+    add_files("tools/generator.cc", "tools/gen.cc")
+    add_deps("zlib")
+    add_cxxflags("-std=c++17")
+
+-- end to end scaling runs of filterx, xmake run filterx-harness
+target("filterx-harness")
+    set_kind("binary")
+    set_default(false)
+    add_includedirs("tools", "deps/zlib")
+    add_files("tools/generator.cc", "tools/harness.cc")
+    add_deps("zlib", "filterx")
     add_cxxflags("-std=c++17")